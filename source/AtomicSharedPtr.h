@@ -0,0 +1,37 @@
+#pragma once
+#include <atomic>
+#include <memory>
+
+// shared_ptr that can be read and replaced concurrently: readers get their own
+// reference, so whatever they point to stays alive until they release it,
+// however many times the pointer was replaced in the meantime.
+// Uses std::atomic<std::shared_ptr> where the standard library provides it,
+// and the (C++11) atomic free functions otherwise.
+template <class T> class atomic_shared_ptr {
+public:
+  atomic_shared_ptr() = default;
+  explicit atomic_shared_ptr(std::shared_ptr<T> ptr) : _ptr(std::move(ptr)) {}
+
+#if defined(__cpp_lib_atomic_shared_ptr)
+  std::shared_ptr<T> load() const {
+    return _ptr.load(std::memory_order_acquire);
+  }
+  std::shared_ptr<T> exchange(std::shared_ptr<T> ptr) {
+    return _ptr.exchange(std::move(ptr), std::memory_order_acq_rel);
+  }
+
+private:
+  std::atomic<std::shared_ptr<T>> _ptr;
+#else
+  std::shared_ptr<T> load() const { return std::atomic_load(&_ptr); }
+  std::shared_ptr<T> exchange(std::shared_ptr<T> ptr) {
+    return std::atomic_exchange(&_ptr, std::move(ptr));
+  }
+
+private:
+  std::shared_ptr<T> _ptr;
+#endif
+
+  atomic_shared_ptr(const atomic_shared_ptr &) = delete;
+  atomic_shared_ptr &operator=(const atomic_shared_ptr &) = delete;
+};
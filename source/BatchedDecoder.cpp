@@ -0,0 +1,114 @@
+#include "BatchedDecoder.h"
+#include <algorithm>
+
+BatchedDecoder &BatchedDecoder::getInstance() {
+  static BatchedDecoder decoder;
+  return decoder;
+}
+
+void BatchedDecoder::leave(const void *participant) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  for (auto it = _participants.begin(); it != _participants.end();) {
+    it->second.erase(participant);
+    if (it->second.empty())
+      it = _participants.erase(it);
+    else
+      ++it;
+  }
+  // a batch may have been waiting for this instance
+  _changed.notify_all();
+}
+
+int BatchedDecoder::countParticipants(
+    const Key &key, std::chrono::steady_clock::time_point stale) {
+  auto participants = _participants.find(key);
+  if (participants == _participants.end())
+    return 0;
+  auto &times = participants->second;
+  for (auto it = times.begin(); it != times.end();) {
+    if (it->second < stale)
+      it = times.erase(it);
+    else
+      ++it;
+  }
+  return (int)times.size();
+}
+
+at::Tensor BatchedDecoder::decode(const ModelCache::ModulePtr &module,
+                                  const void *participant,
+                                  const at::Tensor &latent, int64_t batchDim,
+                                  std::chrono::microseconds frameDuration) {
+  const Key key(module.get(), std::vector<int64_t>(latent.sizes().begin() + 1,
+                                                   latent.sizes().end()));
+  const auto now = std::chrono::steady_clock::now();
+  std::unique_lock<std::mutex> lock(_mutex);
+  _participants[key][participant] = now;
+  const int expected =
+      countParticipants(key, now - staleFrames * frameDuration);
+
+  auto it = std::find_if(_open.begin(), _open.end(), [&](const auto &batch) {
+    return batch->module == module && batch->shape == key.second;
+  });
+  const bool leader = it == _open.end();
+  if (leader && expected <= 1) {
+    // nobody to wait for
+    lock.unlock();
+    std::vector<torch::jit::IValue> inputs = {latent};
+    return module->get_method("decode")(inputs).toTensor();
+  }
+
+  std::shared_ptr<Batch> batch;
+  if (leader) {
+    batch = std::make_shared<Batch>();
+    batch->module = module;
+    batch->shape = key.second;
+    batch->batchDim = batchDim;
+    _open.push_back(batch);
+  } else {
+    batch = *it;
+  }
+  const size_t index = batch->inputs.size();
+  batch->inputs.push_back(latent);
+
+  if (leader) {
+    auto complete = [&]() {
+      return (int)batch->inputs.size() >=
+             countParticipants(key, now - staleFrames * frameDuration);
+    };
+    // no longer than a tenth of the frame
+    _changed.wait_for(lock, frameDuration / 10, complete);
+    _open.erase(std::find(_open.begin(), _open.end(), batch));
+    lock.unlock();
+    run(*batch);
+    lock.lock();
+    batch->done = true;
+    _changed.notify_all();
+  } else {
+    _changed.notify_all();
+    _changed.wait(lock, [&]() { return batch->done; });
+  }
+
+  if (batch->error)
+    std::rethrow_exception(batch->error);
+  return batch->outputs[index];
+}
+
+void BatchedDecoder::run(Batch &batch) {
+  try {
+    c10::InferenceMode guard;
+    std::vector<int64_t> sizes;
+    for (const auto &input : batch.inputs)
+      sizes.push_back(input.size(0));
+    std::vector<torch::jit::IValue> inputs = {at::cat(batch.inputs, 0)};
+    at::Tensor out = batch.module->get_method("decode")(inputs).toTensor();
+    int64_t dim = batch.batchDim;
+    if (dim < 0) {
+      // only unknown for mono models, whose channel dimension is 1
+      const int64_t total = inputs[0].toTensor().size(0);
+      dim = (out.size(0) == total || out.dim() < 2) ? 0 : 1;
+    }
+    batch.outputs = out.split_with_sizes(sizes, dim).vec();
+  } catch (...) {
+    batch.error = std::current_exception();
+  }
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include "ModelCache.h"
+#include <JuceHeader.h>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Opt-in service shared by the plugin instances running the same (cached)
+// model: their decode calls are gathered and run as one batched call, which
+// is much cheaper on CPU than as many calls with a batch of one.
+//
+// There is no dedicated thread: the first instance submitting a batch waits
+// for the other participants of its model and latent shape, at most for a
+// tenth of the frame, then decodes for everyone and hands each instance its
+// share. Participants are the instances that submitted that shape within
+// the last staleFrames frames, so that an instance at another latency mode,
+// muted or bypassed is not waited for. Only stateless modules can be
+// batched this way, as the batch mixes instances.
+class BatchedDecoder {
+public:
+  static BatchedDecoder &getInstance();
+
+  // Stops waiting for participant, e.g. when it is muted or destroyed
+  void leave(const void *participant);
+
+  // Decodes latent ({batch, latent dims, steps}) with module, batched with the
+  // latents of the same shape the other participants submit. batchDim is the
+  // batch dimension of the output of the module, -1 if unknown. Blocks the
+  // calling thread until the result is ready, and throws whatever the model
+  // threw.
+  at::Tensor decode(const ModelCache::ModulePtr &module,
+                    const void *participant, const at::Tensor &latent,
+                    int64_t batchDim, std::chrono::microseconds frameDuration);
+
+  static constexpr int staleFrames = 2;
+
+private:
+  // module and latent shape, without the batch dimension
+  using Key = std::pair<const torch::jit::Module *, std::vector<int64_t>>;
+
+  struct Batch {
+    ModelCache::ModulePtr module;
+    std::vector<int64_t> shape;
+    int64_t batchDim = -1;
+    std::vector<at::Tensor> inputs;
+    std::vector<at::Tensor> outputs;
+    std::exception_ptr error;
+    bool done = false;
+  };
+
+  BatchedDecoder() = default;
+  // participants of key that submitted since stale, dropping the others
+  int countParticipants(const Key &key,
+                        std::chrono::steady_clock::time_point stale);
+  static void run(Batch &batch);
+
+  std::mutex _mutex;
+  std::condition_variable _changed;
+  // last submission of each participant
+  std::map<Key,
+           std::map<const void *, std::chrono::steady_clock::time_point>>
+      _participants;
+  // batches still accepting latents
+  std::vector<std::shared_ptr<Batch>> _open;
+
+  JUCE_DECLARE_NON_COPYABLE(BatchedDecoder)
+};
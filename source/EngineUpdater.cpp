@@ -1,16 +1,25 @@
 #include "EngineUpdater.h"
+#include "TorchRuntime.h"
+#include <algorithm>
 
-UpdateEngineJob::UpdateEngineJob(RaveAP &processor, const std::string modelFile)
+UpdateEngineJob::UpdateEngineJob(RaveAP &processor, const std::string modelFile,
+                                 int warmUpPasses)
     : ThreadPoolJob("UpdateEngineJob"), mProcessor(processor),
-      mModelFile(modelFile) {}
+      mModelFile(modelFile), mWarmUpPasses(warmUpPasses) {}
 
 UpdateEngineJob::~UpdateEngineJob() {}
 
-bool UpdateEngineJob::waitForFadeOut(size_t waitTimeMs) {
-  for (size_t i = 0; i < waitTimeMs && mProcessor.getIsMuted(); ++i) {
+// Waits for the worker to hand engine back and the editor to drop its
+// reference, returns false if one of them still holds it after waitTimeMs.
+bool UpdateEngineJob::waitForRelease(const std::shared_ptr<RAVE> &engine,
+                                     size_t waitTimeMs) {
+  for (size_t i = 0; i < waitTimeMs; ++i) {
+    mProcessor.releaseRetiredEngine();
+    if (engine.use_count() <= 1 || shouldExit())
+      break;
     Thread::sleep(1);
   }
-  return (mProcessor.getIsMuted());
+  return engine.use_count() <= 1;
 }
 
 auto UpdateEngineJob::runJob() -> JobStatus {
@@ -18,17 +27,60 @@ auto UpdateEngineJob::runJob() -> JobStatus {
     return JobStatus::jobNeedsRunningAgain;
   }
 
-  mProcessor.mute();
-
-  while (!waitForFadeOut(1)) {
-    if (shouldExit()) {
-      return JobStatus::jobNeedsRunningAgain;
+  Tracer::getInstance().setThreadName("RAVE model loading");
+  TorchRuntime::initialise();
+  RAVE_TRACE("model swap");
+  // The new engine is loaded, validated and warmed up on its own, while the
+  // current one keeps playing
+  auto engine = std::make_shared<RAVE>();
+  // the methods are compiled by their first calls, with the executor
+  // settings found to be the fastest for this model if it was tuned. A
+  // module already compiled with other settings is not shared.
+  const Precision precision = mProcessor.getPrecision(mModelFile);
+  const auto tuning = ExecutorTuning::load(juce::File(mModelFile), precision);
+  const ExecutorConfig executor = tuning ? tuning->executor : ExecutorConfig{};
+  {
+    ExecutorConfig::Scope scope(executor);
+    if (!engine->load_model(mModelFile, precision,
+                            executor.getCacheKey())) {
+      DBG("Job failed: could not load " + juce::String(mModelFile));
+      return JobStatus::jobHasFinished;
     }
+    // every frame size, so that changing the latency mode later does not hit
+    // a cold shape either
+    engine->warmUpAll(mWarmUpPasses);
+  }
+  if (tuning)
+    engine->setTunedThreads(tuning->threads);
+  // the processor only moves to the sizes of engine once it is swapped in
+  const int frameSize = mProcessor.getFrameSizeFor(*engine);
+  const auto &timings = engine->getWarmUpTimings();
+  if (std::none_of(timings.begin(), timings.end(),
+                   [frameSize](const WarmUpTiming &timing) {
+                     return timing.frameSize == frameSize;
+                   })) {
+    DBG("Job failed: " + juce::String(mModelFile) +
+        " could not perform a frame");
+    return JobStatus::jobHasFinished;
+  }
+  if (shouldExit()) {
+    return JobStatus::jobHasFinished;
   }
 
-  mProcessor._rave->load_model(mModelFile);
-  mProcessor.updateBufferSizes();
+  // Restarts the pipeline if the model rate changes, otherwise from the next
+  // frame on the worker crossfades to the new engine
+  mProcessor.updateModelSampleRate(*engine);
+  auto previous = mProcessor.swapEngine(engine);
   mProcessor.unmute();
+  if (!tuning && engine->getPrecision() == precision)
+    mProcessor.tuneExecutor(mModelFile, precision);
+
+  // Free the previous model here rather than on the worker thread
+  if (!waitForRelease(previous, 2000)) {
+    DBG("Previous engine still in use, released by the message thread or "
+        "the editor");
+  }
+  previous.reset();
 
   DBG("Job finished");
 
@@ -6,14 +6,17 @@ class RaveAP; // forward declaration
 
 class UpdateEngineJob : public juce::ThreadPoolJob {
 public:
-  explicit UpdateEngineJob(RaveAP &processor, const std::string modelPath);
+  explicit UpdateEngineJob(RaveAP &processor, const std::string modelPath,
+                           int warmUpPasses = DEFAULT_WARMUP_PASSES);
   virtual ~UpdateEngineJob();
   virtual auto runJob() -> JobStatus;
-  bool waitForFadeOut(size_t waitTimeMs);
+  bool waitForRelease(const std::shared_ptr<RAVE> &engine, size_t waitTimeMs);
 
 private:
   RaveAP &mProcessor;
   const std::string mModelFile;
+  // runs of each frame size before the model is swapped in
+  const int mWarmUpPasses;
   // Prevent uncontrolled usage
   UpdateEngineJob(const UpdateEngineJob &);
   UpdateEngineJob &operator=(const UpdateEngineJob &);
@@ -0,0 +1,314 @@
+#include "ExecutorTuner.h"
+#include "ModelCache.h"
+#include "Rave.h"
+#include "ThreadBudget.h"
+#include "ThreadSettings.h"
+#include "TorchRuntime.h"
+#include <algorithm>
+#include <set>
+#include <torch/csrc/jit/passes/tensorexpr_fuser.h>
+#include <torch/version.h>
+
+namespace {
+const juce::Identifier torchId{"torch"};
+const juce::Identifier cpuId{"cpu"};
+const juce::Identifier sizeId{"model_size"};
+const juce::Identifier modifiedId{"model_modified"};
+const juce::Identifier profilingId{"profiling"};
+const juce::Identifier fuserId{"fuser"};
+const juce::Identifier optimizeId{"optimize"};
+const juce::Identifier frameId{"FRAME"};
+const juce::Identifier frameSizeId{"size"};
+const juce::Identifier threadsId{"threads"};
+const juce::Identifier p99Id{"p99_ms"};
+
+std::mutex executorLock;
+// bumped whenever the settings are applied
+juce::uint32 executorGeneration = 0;
+
+// models being tuned, so that instances loading the same one do not tune it
+// twice
+std::mutex tuningLock;
+std::set<juce::String> tuning;
+
+juce::String getExtension(Precision precision) {
+  if (precision == Precision::float32)
+    return ".tuning";
+  return "." + getPrecisionName(precision) + ".tuning";
+}
+
+juce::File getSiblingFile(const juce::File &modelFile, Precision precision) {
+  return modelFile.getSiblingFile(modelFile.getFileNameWithoutExtension() +
+                                  getExtension(precision));
+}
+
+juce::File getCacheFile(const juce::File &modelFile, Precision precision) {
+  return ModelCache::getCacheDirectory().getChildFile(
+      modelFile.getFileName() + getExtension(precision));
+}
+
+double percentile99(std::vector<double> values) {
+  std::sort(values.begin(), values.end());
+  return values[(values.size() - 1) * 99 / 100];
+}
+} // namespace
+
+juce::String ExecutorConfig::toString() const {
+  if (!profiling)
+    return optimize ? "simple executor" : "simple executor, unoptimized";
+  return fuser ? "profiling executor, fuser" : "profiling executor";
+}
+
+std::string ExecutorConfig::getCacheKey() const {
+  if (*this == ExecutorConfig())
+    return {};
+  return std::string("executor") + (profiling ? "-profiling" : "") +
+         (fuser ? "-fuser" : "") + (optimize ? "-optimize" : "");
+}
+
+std::vector<ExecutorConfig> ExecutorConfig::getCandidates() {
+  return {{false, true, true},
+          {false, true, false},
+          {true, false, true},
+          {true, true, true}};
+}
+
+juce::uint32 ExecutorConfig::apply() const {
+  torch::jit::getProfilingMode() = profiling;
+  torch::jit::setTensorExprFuserEnabled(fuser);
+  torch::jit::setGraphExecutorOptimize(optimize);
+  return ++executorGeneration;
+}
+
+void ExecutorConfig::initialiseProcess() {
+  std::lock_guard<std::mutex> lock(executorLock);
+  ExecutorConfig().apply();
+}
+
+ExecutorConfig::Scope::Scope(const ExecutorConfig &config)
+    : _lock(executorLock) {
+  config.apply();
+}
+
+ExecutorConfig::Scope::~Scope() { ExecutorConfig().apply(); }
+
+ExecutorConfig::Attempt::Attempt(const ExecutorConfig &config) {
+  std::lock_guard<std::mutex> lock(executorLock);
+  _generation = config.apply();
+}
+
+ExecutorConfig::Attempt::~Attempt() {
+  std::lock_guard<std::mutex> lock(executorLock);
+  if (executorGeneration == _generation)
+    ExecutorConfig().apply();
+}
+
+bool ExecutorConfig::Attempt::isCurrent() const {
+  std::lock_guard<std::mutex> lock(executorLock);
+  return executorGeneration == _generation;
+}
+
+const juce::Identifier ExecutorTuning::treeType{"TUNING"};
+
+juce::ValueTree ExecutorTuning::toValueTree(const juce::File &modelFile) const {
+  juce::ValueTree tree(treeType);
+  tree.setProperty(torchId, TORCH_VERSION, nullptr);
+  tree.setProperty(cpuId, juce::SystemStats::getCpuModel(), nullptr);
+  tree.setProperty(sizeId, modelFile.getSize(), nullptr);
+  tree.setProperty(modifiedId,
+                   modelFile.getLastModificationTime().toMilliseconds(),
+                   nullptr);
+  tree.setProperty(profilingId, executor.profiling, nullptr);
+  tree.setProperty(fuserId, executor.fuser, nullptr);
+  tree.setProperty(optimizeId, executor.optimize, nullptr);
+  for (const auto &frame : threads) {
+    juce::ValueTree child(frameId);
+    child.setProperty(frameSizeId, frame.first, nullptr);
+    child.setProperty(threadsId, frame.second, nullptr);
+    auto p99 = p99Ms.find(frame.first);
+    if (p99 != p99Ms.end())
+      child.setProperty(p99Id, p99->second, nullptr);
+    tree.appendChild(child, nullptr);
+  }
+  return tree;
+}
+
+std::optional<ExecutorTuning>
+ExecutorTuning::fromValueTree(const juce::ValueTree &tree,
+                              const juce::File &modelFile) {
+  // timings only hold for the same model, libtorch and machine
+  if (!tree.hasType(treeType) ||
+      tree[torchId].toString() != juce::String(TORCH_VERSION) ||
+      tree[cpuId].toString() != juce::SystemStats::getCpuModel() ||
+      (juce::int64)tree[sizeId] != modelFile.getSize() ||
+      (juce::int64)tree[modifiedId] !=
+          modelFile.getLastModificationTime().toMilliseconds())
+    return std::nullopt;
+  ExecutorTuning tuning;
+  tuning.executor.profiling = tree[profilingId];
+  tuning.executor.fuser = tree[fuserId];
+  tuning.executor.optimize = tree[optimizeId];
+  for (const auto &child : tree) {
+    if (!child.hasType(frameId))
+      continue;
+    const int frameSize = child[frameSizeId];
+    tuning.threads[frameSize] = child[threadsId];
+    if (child.hasProperty(p99Id))
+      tuning.p99Ms[frameSize] = child[p99Id];
+  }
+  return tuning;
+}
+
+std::optional<ExecutorTuning> ExecutorTuning::load(const juce::File &modelFile,
+                                                   Precision precision) {
+  for (const auto &file : {getSiblingFile(modelFile, precision),
+                           getCacheFile(modelFile, precision)}) {
+    if (!file.existsAsFile())
+      continue;
+    if (auto xml = juce::parseXML(file))
+      if (auto tuning =
+              fromValueTree(juce::ValueTree::fromXml(*xml), modelFile))
+        return tuning;
+  }
+  return std::nullopt;
+}
+
+bool ExecutorTuning::save(const juce::File &modelFile,
+                          Precision precision) const {
+  auto xml = toValueTree(modelFile).createXml();
+  if (xml->writeTo(getSiblingFile(modelFile, precision)))
+    return true;
+  ModelCache::getCacheDirectory().createDirectory();
+  return xml->writeTo(getCacheFile(modelFile, precision));
+}
+
+ExecutorTuneJob::ExecutorTuneJob(const juce::File &modelFile,
+                                 Precision precision, int maxThreads)
+    : ThreadPoolJob("ExecutorTuneJob"), _modelFile(modelFile),
+      _precision(precision), _maxThreads(juce::jmax(1, maxThreads)) {}
+
+auto ExecutorTuneJob::runJob() -> JobStatus {
+  const juce::String path =
+      _modelFile.getFullPathName() +
+      (_precision == Precision::float32
+           ? ""
+           : " (" + getPrecisionName(_precision) + ")");
+  {
+    std::lock_guard<std::mutex> lock(tuningLock);
+    if (!tuning.insert(path).second)
+      return JobStatus::jobHasFinished;
+  }
+  auto release = [&path]() {
+    std::lock_guard<std::mutex> lock(tuningLock);
+    tuning.erase(path);
+  };
+
+  // before torch starts the threads of this one, which inherit it
+  setBackgroundPriority();
+  TorchRuntime::initialise();
+  // the executors are built again for each configuration below, loading
+  // does not need to keep the settings
+  RAVE engine;
+  if (!engine.load_model(_modelFile.getFullPathName().toStdString(),
+                         _precision) ||
+      engine.getPrecision() != _precision) {
+    release();
+    return JobStatus::jobHasFinished;
+  }
+  std::vector<int> frameSizes;
+  for (int frameSize = (int)engine.getValidBufferSizes().getStart();
+       frameSize <= (int)engine.getValidBufferSizes().getEnd(); frameSize *= 2)
+    frameSizes.push_back(frameSize);
+  std::vector<int> threadCounts;
+  // never more than the instance could be given
+  const int budget =
+      juce::jmin(_maxThreads, ThreadBudget::getInstance().getBudget());
+  for (int threads = 1; threads < budget; threads *= 2)
+    threadCounts.push_back(threads);
+  threadCounts.push_back(budget);
+
+  std::cout << "[ ] RAVE - Tuning " << path << std::endl;
+  std::optional<ExecutorTuning> best;
+  double bestLoad = 0;
+  for (const auto &config : ExecutorConfig::getCandidates()) {
+    ExecutorTuning candidate;
+    candidate.executor = config;
+    double load = 0;
+    try {
+      // the executors are built with config by the first passes of each
+      // frame size, at the largest thread count, and built again if a load
+      // applied its own settings meanwhile. The settings of the process are
+      // only switched for those passes, the other engines keep playing.
+      bool compiled = false;
+      for (int attempt = 0; attempt < compileAttempts && !compiled;
+           attempt++) {
+        engine.recompile();
+        at::set_num_threads(threadCounts.back());
+        compiled = true;
+        for (int frameSize : frameSizes) {
+          at::Tensor input = torch::zeros({1, 1, frameSize});
+          {
+            ExecutorConfig::Attempt scope(config);
+            for (int pass = 0; pass < compilePasses; pass++)
+              engine.timeFrame(*engine.getWorkspace(frameSize), input);
+            compiled = scope.isCurrent();
+          }
+          if (shouldExit()) {
+            release();
+            return JobStatus::jobHasFinished;
+          }
+          if (!compiled)
+            break;
+        }
+      }
+      if (!compiled) {
+        std::cerr << "[-] RAVE - " << config.toString()
+                  << " skipped, models kept loading" << std::endl;
+        continue;
+      }
+      for (int frameSize : frameSizes) {
+        at::Tensor input = torch::zeros({1, 1, frameSize});
+        for (int threads : threadCounts) {
+          at::set_num_threads(threads);
+          std::vector<double> timings;
+          for (int pass = 0; pass < timedPasses; pass++)
+            timings.push_back(
+                engine.timeFrame(*engine.getWorkspace(frameSize), input));
+          const double p99 = percentile99(timings);
+          // more threads only if they are worth it
+          if (candidate.p99Ms.count(frameSize) == 0 ||
+              p99 < candidate.p99Ms[frameSize] * (1.0 - margin)) {
+            candidate.p99Ms[frameSize] = p99;
+            candidate.threads[frameSize] = threads;
+          }
+          if (shouldExit()) {
+            release();
+            return JobStatus::jobHasFinished;
+          }
+        }
+        // every latency mode weighs the same
+        load += candidate.p99Ms[frameSize] / frameSize;
+      }
+    } catch (const c10::Error &e) {
+      std::cerr << e.what();
+      std::cerr << "[-] RAVE - " << config.toString() << " failed" << std::endl;
+      continue;
+    }
+    std::cout << "\t" << config.toString() << ": " << load << std::endl;
+    // the default executor first, the others have to beat it
+    if (!best || load < bestLoad * (1.0 - margin)) {
+      best = candidate;
+      bestLoad = load;
+    }
+  }
+
+  if (best) {
+    std::cout << "[ ] RAVE - Tuned " << path << ": "
+              << best->executor.toString() << std::endl;
+    if (!best->save(_modelFile, _precision))
+      std::cerr << "[-] RAVE - cannot save the tuning of " << path
+                << std::endl;
+  }
+  release();
+  return JobStatus::jobHasFinished;
+}
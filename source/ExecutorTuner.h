@@ -0,0 +1,119 @@
+#pragma once
+#include "Precision.h"
+#include <JuceHeader.h>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+// Settings of libtorch's graph executor. They are process wide and read
+// whenever a graph is compiled: the kind of executor of a method on its first
+// call, and the optimizations every time a graph is specialized, which the
+// profiling executor does again for new shapes or when a guard fails. Each
+// model is loaded and warmed up within a Scope applying its own, an engine
+// then only compiles again in those cases. The tuner, whose passes can be
+// redone, uses an Attempt instead so that loads do not wait for it, and only
+// for the first passes of a frame size: engines compiling in such a window
+// pick its settings up.
+struct ExecutorConfig {
+  // profiling executor, which specializes the graphs on the shapes it sees,
+  // rather than the simple one
+  bool profiling = false;
+  // TensorExpr fuser, only used by the profiling executor
+  bool fuser = true;
+  // graph optimizations of the simple executor
+  bool optimize = true;
+
+  bool operator==(const ExecutorConfig &other) const {
+    return profiling == other.profiling && fuser == other.fuser &&
+           optimize == other.optimize;
+  }
+  juce::String toString() const;
+  // tells apart the modules of ModelCache compiled with these settings,
+  // empty for the default ones
+  std::string getCacheKey() const;
+  // the configurations tried by ExecutorTuneJob, the default one first
+  static std::vector<ExecutorConfig> getCandidates();
+  // applies the default configuration, for what runs outside of a Scope
+  static void initialiseProcess();
+
+  // Applies config until destroyed, then the default one again. Scopes of
+  // different threads wait for each other.
+  class Scope {
+  public:
+    explicit Scope(const ExecutorConfig &config);
+    ~Scope();
+
+  private:
+    std::unique_lock<std::mutex> _lock;
+    JUCE_DECLARE_NON_COPYABLE(Scope)
+  };
+
+  // Applies config without keeping other threads from applying theirs, then
+  // the default one again unless it was replaced. isCurrent() tells whether
+  // config held all along.
+  class Attempt {
+  public:
+    explicit Attempt(const ExecutorConfig &config);
+    ~Attempt();
+    bool isCurrent() const;
+
+  private:
+    juce::uint32 _generation;
+    JUCE_DECLARE_NON_COPYABLE(Attempt)
+  };
+
+private:
+  // returns the generation of the settings, under executorLock
+  juce::uint32 apply() const;
+};
+
+// Fastest executor configuration and thread counts for a model on this
+// machine, as measured by ExecutorTuneJob
+struct ExecutorTuning {
+  ExecutorConfig executor;
+  // frame size -> torch threads
+  std::map<int, int> threads;
+  // frame size -> p99 of a frame with those, in ms
+  std::map<int, double> p99Ms;
+
+  static const juce::Identifier treeType;
+  juce::ValueTree toValueTree(const juce::File &modelFile) const;
+  // nullopt if tree was made for another model file, libtorch or CPU
+  static std::optional<ExecutorTuning>
+  fromValueTree(const juce::ValueTree &tree, const juce::File &modelFile);
+
+  // Saved next to the model, or in the cache directory if that one cannot
+  // be written. Each precision of a model has a tuning of its own.
+  static std::optional<ExecutorTuning> load(const juce::File &modelFile,
+                                            Precision precision);
+  bool save(const juce::File &modelFile, Precision precision) const;
+};
+
+// Benchmarks every candidate executor configuration and torch thread count
+// on every frame size of a model, and saves the fastest at the 99th
+// percentile. Runs in the background after the first load of the model, the
+// result is applied by the following loads.
+class ExecutorTuneJob : public juce::ThreadPoolJob {
+public:
+  // maxThreads: the torch threads of the instance asking, the most it could
+  // use
+  ExecutorTuneJob(const juce::File &modelFile, Precision precision,
+                  int maxThreads);
+  JobStatus runJob() override;
+
+  // passes of each frame size per configuration: the first ones let the
+  // executor compile and are not timed
+  static constexpr int compilePasses = 3;
+  static constexpr int timedPasses = 10;
+  // a configuration replaces a cheaper one (the default executor, fewer
+  // threads) only if it is faster by more than this
+  static constexpr double margin = 0.05;
+  // times a configuration is compiled again after a load replaced it
+  static constexpr int compileAttempts = 3;
+
+private:
+  const juce::File _modelFile;
+  const Precision _precision;
+  const int _maxThreads;
+};
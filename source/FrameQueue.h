@@ -0,0 +1,84 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// A frame of model input, from the moment processBlock completes it to the
+// moment the worker has written its output. The state is the ownership flag
+// shared by the audio thread and the inference worker: the worker may only
+// compute a frame it managed to move from queued to computing, and the audio
+// thread may only give up on a frame that is still queued.
+struct FrameTicket {
+  enum State : int { queued = 0, computing, done, abandoned };
+  int64_t start = 0; // index of its first sample in the input stream
+  int size = 0;
+  std::atomic<int> state{done};
+};
+
+// Single-producer (audio thread) / single-consumer (inference worker) queue of
+// the frames waiting to be performed, oldest first.
+class FrameQueue {
+public:
+  static constexpr size_t capacity = 64;
+
+  // Audio thread: queues a frame, false if too many are already pending
+  bool push(int64_t start, int size) {
+    const size_t w = _write.load(std::memory_order_relaxed);
+    if (w - _read.load(std::memory_order_acquire) >= capacity)
+      return false;
+    FrameTicket &ticket = _tickets[w % capacity];
+    ticket.start = start;
+    ticket.size = size;
+    ticket.state.store(FrameTicket::queued, std::memory_order_relaxed);
+    _write.store(w + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Audio thread: gives up on every frame that has not started yet and whose
+  // output is needed before the deadline sample. It will be played as
+  // silence, and the worker skips it instead of computing it too late.
+  void abandonLate(int64_t deadline) {
+    const size_t w = _write.load(std::memory_order_relaxed);
+    for (size_t r = _read.load(std::memory_order_acquire); r < w; r++) {
+      FrameTicket &ticket = _tickets[r % capacity];
+      if (ticket.start >= deadline)
+        break;
+      int expected = FrameTicket::queued;
+      ticket.state.compare_exchange_strong(expected, FrameTicket::abandoned,
+                                           std::memory_order_acq_rel);
+    }
+  }
+
+  // Worker: oldest pending frame, or nullptr
+  FrameTicket *front() { return at(0); }
+
+  // Worker: i-th oldest pending frame, or nullptr
+  FrameTicket *at(size_t i) {
+    const size_t r = _read.load(std::memory_order_relaxed);
+    if (r + i >= _write.load(std::memory_order_acquire))
+      return nullptr;
+    return &_tickets[(r + i) % capacity];
+  }
+
+  // Worker: releases the n oldest frames
+  void pop(size_t n = 1) {
+    _read.store(_read.load(std::memory_order_relaxed) + n,
+                std::memory_order_release);
+  }
+
+  size_t size() const {
+    return _write.load(std::memory_order_acquire) -
+           _read.load(std::memory_order_acquire);
+  }
+
+  // Only when neither side is running
+  void clear() {
+    _read.store(0);
+    _write.store(0);
+  }
+
+private:
+  std::array<FrameTicket, capacity> _tickets;
+  alignas(64) std::atomic<size_t> _write{0};
+  alignas(64) std::atomic<size_t> _read{0};
+};
@@ -0,0 +1,123 @@
+#include "InferenceWorker.h"
+
+#if JUCE_MAC || JUCE_IOS
+#include <dispatch/dispatch.h>
+#elif JUCE_WINDOWS
+#define NOMINMAX
+#include <climits>
+#include <windows.h>
+#else
+#include <cerrno>
+#include <semaphore.h>
+#endif
+
+#if JUCE_MAC || JUCE_IOS
+struct FrameSignal::Impl {
+  Impl() : sem(dispatch_semaphore_create(0)) {}
+  ~Impl() { dispatch_release(sem); }
+  void post() { dispatch_semaphore_signal(sem); }
+  void wait() { dispatch_semaphore_wait(sem, DISPATCH_TIME_FOREVER); }
+  dispatch_semaphore_t sem;
+};
+#elif JUCE_WINDOWS
+struct FrameSignal::Impl {
+  Impl() : sem(CreateSemaphore(nullptr, 0, LONG_MAX, nullptr)) {}
+  ~Impl() { CloseHandle(sem); }
+  void post() { ReleaseSemaphore(sem, 1, nullptr); }
+  void wait() { WaitForSingleObject(sem, INFINITE); }
+  HANDLE sem;
+};
+#else
+struct FrameSignal::Impl {
+  Impl() { sem_init(&sem, 0, 0); }
+  ~Impl() { sem_destroy(&sem); }
+  void post() { sem_post(&sem); }
+  void wait() {
+    while (sem_wait(&sem) != 0 && errno == EINTR) {
+    }
+  }
+  sem_t sem;
+};
+#endif
+
+FrameSignal::FrameSignal() : _impl(std::make_unique<Impl>()) {}
+
+FrameSignal::~FrameSignal() {}
+
+void FrameSignal::post() { _impl->post(); }
+
+void FrameSignal::wait() { _impl->wait(); }
+
+InferenceWorker::InferenceWorker(std::function<void()> job)
+    : juce::Thread("RAVE inference"), _job(std::move(job)) {}
+
+InferenceWorker::~InferenceWorker() { stop(); }
+
+void InferenceWorker::start() {
+  _pending.store(false);
+  _running.store(false);
+  startThread();
+}
+
+void InferenceWorker::stop() {
+  signalThreadShouldExit();
+  _signal.post();
+  stopThread(10000);
+}
+
+void InferenceWorker::submit() {
+  if (!_pending.exchange(true, std::memory_order_acq_rel))
+    _signal.post();
+}
+
+void InferenceWorker::setThreadSettings(const ThreadSettings &settings) {
+  {
+    std::lock_guard<std::mutex> lock(_settingsLock);
+    _settings = settings;
+  }
+  _settingsChanged.store(true, std::memory_order_release);
+  _signal.post();
+}
+
+ThreadReport InferenceWorker::getThreadReport() const {
+  std::lock_guard<std::mutex> lock(_settingsLock);
+  return _report;
+}
+
+void InferenceWorker::configureThread() {
+  ThreadSettings settings;
+  ThreadReport previous;
+  {
+    std::lock_guard<std::mutex> lock(_settingsLock);
+    settings = _settings;
+    previous = _report;
+  }
+  auto report = applyThreadSettings(settings, previous);
+  std::lock_guard<std::mutex> lock(_settingsLock);
+  _report = report;
+}
+
+void InferenceWorker::run() {
+  Tracer::getInstance().setThreadName("RAVE inference");
+  {
+    // a restarted worker is a new thread, with the default priority and cores
+    std::lock_guard<std::mutex> lock(_settingsLock);
+    _report = ThreadReport();
+  }
+  _settingsChanged.store(false, std::memory_order_release);
+  configureThread();
+  while (!threadShouldExit()) {
+    _signal.wait();
+    if (threadShouldExit())
+      break;
+    if (_settingsChanged.exchange(false, std::memory_order_acq_rel))
+      configureThread();
+    // woken up for the settings only
+    if (!_pending.load(std::memory_order_acquire))
+      continue;
+    _running.store(true, std::memory_order_release);
+    _pending.store(false, std::memory_order_release);
+    _job();
+    _running.store(false, std::memory_order_release);
+  }
+}
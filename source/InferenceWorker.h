@@ -0,0 +1,64 @@
+#pragma once
+#include "ThreadSettings.h"
+#include "Tracer.h"
+#include <JuceHeader.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+// Counting semaphore posted from the audio thread. Posting never takes a lock
+// (futex / dispatch / kernel semaphore), so it is safe to call in processBlock.
+class FrameSignal {
+public:
+  FrameSignal();
+  ~FrameSignal();
+  void post();
+  void wait();
+
+private:
+  struct Impl;
+  std::unique_ptr<Impl> _impl;
+  JUCE_DECLARE_NON_COPYABLE(FrameSignal)
+};
+
+// Long-lived thread running the inference job whenever it is woken up. The
+// audio thread only ever submits; it never joins nor waits. A submit made
+// while the job runs schedules one more run right after it, so no frame is
+// left behind.
+class InferenceWorker : public juce::Thread {
+public:
+  explicit InferenceWorker(std::function<void()> job);
+  ~InferenceWorker() override;
+
+  void run() override;
+  void start();
+  void stop();
+
+  // Audio thread side
+  bool isBusy() const {
+    return _pending.load(std::memory_order_acquire) ||
+           _running.load(std::memory_order_acquire);
+  }
+  void submit();
+
+  // Taken into account by the worker thread before its next run, it wakes up
+  // for it if idle. Also reapplied whenever the thread is restarted.
+  void setThreadSettings(const ThreadSettings &settings);
+  ThreadReport getThreadReport() const;
+
+private:
+  void configureThread();
+
+  std::function<void()> _job;
+  std::atomic<bool> _pending{false};
+  std::atomic<bool> _running{false};
+  FrameSignal _signal;
+
+  mutable std::mutex _settingsLock;
+  ThreadSettings _settings;
+  ThreadReport _report;
+  std::atomic<bool> _settingsChanged{false};
+
+  JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(InferenceWorker)
+};
@@ -0,0 +1,65 @@
+#include "LatencyGovernor.h"
+
+static const WarmUpTiming *findTiming(const std::vector<WarmUpTiming> &timings,
+                                      int frameSize) {
+  for (const auto &timing : timings)
+    if (timing.frameSize == frameSize && timing.steadyMs > 0)
+      return &timing;
+  return nullptr;
+}
+
+static double durationMs(int frameSize, double sampleRate) {
+  return 1000.0 * frameSize / sampleRate;
+}
+
+double
+LatencyGovernor::estimateMs(int frameSize, const Measure &m,
+                            const std::vector<WarmUpTiming> &timings) const {
+  const double measuredMs = m.peakLoad * durationMs(m.frameSize, m.sampleRate);
+  const WarmUpTiming *current = findTiming(timings, m.frameSize);
+  const WarmUpTiming *other = findTiming(timings, frameSize);
+  if (current != nullptr && other != nullptr)
+    return other->steadyMs * measuredMs / current->steadyMs;
+  // without timings, assume the worst: smaller frames take as long, larger
+  // ones take proportionally longer
+  return frameSize < m.frameSize ? measuredMs
+                                 : measuredMs * frameSize / m.frameSize;
+}
+
+int LatencyGovernor::update(const Measure &m,
+                            const std::vector<WarmUpTiming> &timings,
+                            juce::Range<float> validSizes) {
+  if (m.frameSize <= 0 || m.sampleRate <= 0)
+    return m.frameSize;
+  if (_ignoredPeriods > 0) {
+    _ignoredPeriods--;
+    return m.frameSize;
+  }
+  const int smallest = (int)validSizes.getStart();
+  const int largest = (int)validSizes.getEnd();
+  auto loadOf = [&](int frameSize) {
+    return estimateMs(frameSize, m, timings) /
+           durationMs(frameSize, m.sampleRate);
+  };
+
+  if (m.missedFrames > 0 || m.peakLoad > targetLoad) {
+    // too close to the deadline: at least one step up, more if needed
+    _calmPeriods = 0;
+    int frameSize = m.frameSize * 2;
+    while (frameSize < largest && loadOf(frameSize) > targetLoad)
+      frameSize *= 2;
+    return juce::jmin(frameSize, largest);
+  }
+
+  // nothing was performed, e.g. while muted: nothing to learn
+  if (m.peakLoad <= 0)
+    return m.frameSize;
+  if (++_calmPeriods < calmPeriodsToShrink)
+    return m.frameSize;
+  const int smaller = m.frameSize / 2;
+  if (smaller >= smallest && loadOf(smaller) < shrinkLoad) {
+    _calmPeriods = 0;
+    return smaller;
+  }
+  return m.frameSize;
+}
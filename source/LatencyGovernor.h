@@ -0,0 +1,48 @@
+#pragma once
+#include "Rave.h"
+#include <vector>
+
+// Chooses the latency mode in auto mode: the smallest frame the model
+// computes in time with a safety margin. Measured inference times are
+// projected onto the other frame sizes through the engine's warm-up timings,
+// scaled by how much slower the machine currently is than during warm-up.
+// Frames grow as soon as they come close to their deadline, and shrink one
+// step at a time, after a while without any trouble.
+class LatencyGovernor {
+public:
+  struct Measure {
+    int frameSize = 0;
+    double sampleRate = 0;
+    // worst inference time over the period, in proportion of the frame's
+    // duration, 0 if no frame was performed
+    double peakLoad = 0;
+    // frames given up by the audio thread during the period
+    int missedFrames = 0;
+  };
+
+  // Starts over, e.g. after a latency or model change: the next period is
+  // ignored, as frames given up while switching would count as missed
+  void reset() {
+    _calmPeriods = 0;
+    _ignoredPeriods = 1;
+  }
+
+  // Returns the frame size to use, m.frameSize to keep it.
+  int update(const Measure &m, const std::vector<WarmUpTiming> &timings,
+             juce::Range<float> validSizes);
+
+  // highest load a frame size is chosen for, and the one it has to be under
+  // for a smaller size to be tried
+  static constexpr double targetLoad = 0.7;
+  static constexpr double shrinkLoad = 0.5;
+  // periods without trouble before trying a smaller frame
+  static constexpr int calmPeriodsToShrink = 10;
+
+private:
+  // expected inference time of frameSize, in ms
+  double estimateMs(int frameSize, const Measure &m,
+                    const std::vector<WarmUpTiming> &timings) const;
+
+  int _calmPeriods = 0;
+  int _ignoredPeriods = 1;
+};
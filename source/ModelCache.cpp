@@ -0,0 +1,384 @@
+#include "ModelCache.h"
+#include <algorithm>
+#include <caffe2/serialize/inline_container.h>
+#include <cstring>
+#include <set>
+#include <torch/csrc/jit/ir/constants.h>
+#include <torch/csrc/jit/ir/ir.h>
+#include <torch/version.h>
+
+#if JUCE_WINDOWS
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+// Copy-on-write mapping of a whole file: its pages are shared with the page
+// cache until written to, which gives the writer a private copy of them
+// rather than a fault, e.g. a model updating a parameter in place. The
+// file does not need to stay open, but Windows refuses to delete or replace
+// it while mapped.
+class FileMapping {
+public:
+  explicit FileMapping(const juce::File &file) {
+#if JUCE_WINDOWS
+    HANDLE handle = CreateFileW(file.getFullPathName().toWideCharPointer(),
+                                GENERIC_READ,
+                                FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+                                OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle == INVALID_HANDLE_VALUE)
+      return;
+    LARGE_INTEGER size;
+    if (GetFileSizeEx(handle, &size) && size.QuadPart > 0) {
+      HANDLE mapping = CreateFileMappingW(handle, nullptr, PAGE_WRITECOPY, 0,
+                                          0, nullptr);
+      if (mapping != nullptr) {
+        _data = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+        if (_data != nullptr)
+          _size = (size_t)size.QuadPart;
+        CloseHandle(mapping);
+      }
+    }
+    CloseHandle(handle);
+#else
+    const int fd = open(file.getFullPathName().toRawUTF8(), O_RDONLY);
+    if (fd < 0)
+      return;
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+      void *data = mmap(nullptr, (size_t)info.st_size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE, fd, 0);
+      if (data != MAP_FAILED) {
+        _data = data;
+        _size = (size_t)info.st_size;
+      }
+    }
+    close(fd);
+#endif
+  }
+
+  ~FileMapping() {
+    if (_data == nullptr)
+      return;
+#if JUCE_WINDOWS
+    UnmapViewOfFile(_data);
+#else
+    munmap(_data, _size);
+#endif
+  }
+
+  char *getData() const { return static_cast<char *>(_data); }
+  size_t getSize() const { return _size; }
+
+private:
+  void *_data = nullptr;
+  size_t _size = 0;
+  JUCE_DECLARE_NON_COPYABLE(FileMapping)
+};
+
+// Reads the archive straight from the mapping instead of through a stream
+class MappedAdapter : public caffe2::serialize::ReadAdapterInterface {
+public:
+  explicit MappedAdapter(std::shared_ptr<FileMapping> mapping)
+      : _mapping(std::move(mapping)) {}
+
+  size_t size() const override { return _mapping->getSize(); }
+
+  size_t read(uint64_t pos, void *buf, size_t n,
+              const char *what = "") const override {
+    if (pos >= size())
+      return 0;
+    n = std::min(n, (size_t)(size() - pos));
+    std::memcpy(buf, _mapping->getData() + pos, n);
+    return n;
+  }
+
+private:
+  std::shared_ptr<FileMapping> _mapping;
+};
+
+void collectConstants(const torch::jit::Block *block,
+                      std::vector<at::Tensor> &tensors) {
+  for (const torch::jit::Node *node : block->nodes()) {
+    if (node->kind() == c10::prim::Constant) {
+      auto value = torch::jit::toIValue(node->output());
+      if (value && value->isTensor())
+        tensors.push_back(value->toTensor());
+    }
+    for (const torch::jit::Block *child : node->blocks())
+      collectConstants(child, tensors);
+  }
+}
+
+// Points the storages of the weights of module at the records of the archive
+// with the same bytes, and frees their copies. Buffers are left alone, as a
+// model updates them on every call. Returns the number of bytes moved.
+size_t mapWeights(const torch::jit::Module &module,
+                  const std::shared_ptr<FileMapping> &mapping,
+                  caffe2::serialize::PyTorchStreamReader &reader) {
+  // tensors are stored uncompressed, 64 bytes aligned
+  std::vector<size_t> offsets;
+  for (const auto &record : reader.getAllRecords())
+    if (record.find("/data/") != std::string::npos ||
+        record.find("/constants/") != std::string::npos)
+      offsets.push_back(reader.getRecordOffset(record));
+
+  std::vector<at::Tensor> tensors;
+  for (const auto &param : module.named_parameters(true))
+    tensors.push_back(param.value);
+  // frozen modules hold their weights as constants of the graphs
+  for (const auto &method : module.get_methods())
+    collectConstants(method.graph()->block(), tensors);
+
+  char *data = mapping->getData();
+  std::set<const c10::StorageImpl *> mapped;
+  size_t bytes = 0;
+  for (const auto &tensor : tensors) {
+    if (!tensor.defined() || !tensor.device().is_cpu() ||
+        !tensor.has_storage())
+      continue;
+    c10::StorageImpl *storage = tensor.storage().unsafeGetStorageImpl();
+    const size_t size = storage->nbytes();
+    if (size == 0 || !mapped.insert(storage).second)
+      continue;
+    for (auto it = offsets.begin(); it != offsets.end(); ++it) {
+      if (*it + size > mapping->getSize() ||
+          std::memcmp(data + *it, storage->data(), size) != 0)
+        continue;
+      // the DataPtr keeps the mapping alive
+      auto *context = new std::shared_ptr<FileMapping>(mapping);
+      storage->set_data_ptr_noswap(at::DataPtr(
+          data + *it, context,
+          [](void *ctx) {
+            delete static_cast<std::shared_ptr<FileMapping> *>(ctx);
+          },
+          at::Device(at::kCPU)));
+      bytes += size;
+      offsets.erase(it);
+      break;
+    }
+  }
+  return bytes;
+}
+} // namespace
+
+ModelCache &ModelCache::getInstance() {
+  static ModelCache cache;
+  return cache;
+}
+
+std::string ModelCache::contentKey(const std::string &modelFile) {
+  juce::File file(modelFile);
+  return juce::SHA256(file).toHexString().toStdString() + "-" +
+         std::to_string(file.getSize());
+}
+
+ModelCache::ModulePtr
+ModelCache::getOrLoad(const std::string &key,
+                      const std::function<ModulePtr()> &load) {
+  std::promise<ModulePtr> promise;
+  std::shared_future<ModulePtr> loading;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto it = _modules.begin(); it != _modules.end();) {
+      if (it->second.module.expired() && !it->second.loading.valid())
+        it = _modules.erase(it);
+      else
+        ++it;
+    }
+    Entry &entry = _modules[key];
+    if (auto module = entry.module.lock())
+      return module;
+    if (entry.loading.valid())
+      loading = entry.loading;
+    else
+      entry.loading = promise.get_future().share();
+  }
+  // instances asking for the same model at the same time wait for the first
+  // load instead of duplicating it
+  if (loading.valid())
+    return loading.get();
+
+  ModulePtr module;
+  try {
+    module = load();
+  } catch (...) {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _modules.erase(key);
+    }
+    promise.set_exception(std::current_exception());
+    throw;
+  }
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    Entry &entry = _modules[key];
+    entry.module = module;
+    entry.loading = {};
+  }
+  promise.set_value(module);
+  return module;
+}
+
+ModelCache::ModulePtr ModelCache::acquire(const std::string &modelFile,
+                                          const std::string &executor) {
+  bool loaded = false;
+  std::string key = contentKey(modelFile);
+  if (!executor.empty())
+    key += "-" + executor;
+  auto module = getOrLoad(key, [&]() {
+    loaded = true;
+    c10::InferenceMode guard;
+    return std::make_shared<torch::jit::Module>(load(modelFile));
+  });
+  if (!loaded)
+    std::cout << "[ ] RAVE - Sharing already loaded model: " << modelFile
+              << std::endl;
+  return module;
+}
+
+torch::jit::Module ModelCache::load(const std::string &file) {
+  auto mapping = std::make_shared<FileMapping>(juce::File(file));
+  if (mapping->getData() == nullptr) {
+    std::cerr << "[-] RAVE - cannot map " << file << ", loading it in memory"
+              << std::endl;
+    return torch::jit::load(file);
+  }
+  auto adapter = std::make_shared<MappedAdapter>(mapping);
+  torch::jit::Module module = torch::jit::load(adapter);
+  caffe2::serialize::PyTorchStreamReader reader(adapter);
+  const size_t bytes = mapWeights(module, mapping, reader);
+  std::cout << "\tMapped weights: " << bytes / (1024 * 1024) << " MB"
+            << std::endl;
+  return module;
+}
+
+juce::File ModelCache::getCacheDirectory() {
+  // same directory as the models, see RaveAPEditor
+  juce::String path =
+      juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+          .getFullPathName();
+  if (juce::SystemStats::getOperatingSystemType() ==
+      juce::SystemStats::OperatingSystemType::MacOSX)
+    path += juce::String("/Application Support");
+  path += juce::String("/ACIDS/RAVE/cache/");
+  return juce::File(path);
+}
+
+ModelCache::ModulePtr
+ModelCache::acquireOptimized(const std::string &modelFile,
+                             const torch::jit::Module &module,
+                             const std::vector<std::string> &methods,
+                             Precision precision,
+                             const std::string &executor) {
+  // the passes and the serialized graph depend on the libtorch version
+  std::string key = contentKey(modelFile) + "-torch" + TORCH_VERSION;
+  for (const auto &method : methods)
+    key += "-" + method;
+  if (precision != Precision::float32)
+    key += "-" + getPrecisionName(precision).toStdString();
+  // the saved file does not depend on the executor settings
+  return getOrLoad(executor.empty() ? key : key + "-" + executor, [&]() {
+    return loadOptimized(key, module, methods, precision);
+  });
+}
+
+ModelCache::ModulePtr
+ModelCache::loadOptimized(const std::string &key,
+                          const torch::jit::Module &module,
+                          const std::vector<std::string> &methods,
+                          Precision precision) {
+  c10::InferenceMode guard;
+  const juce::File cached =
+      getCacheDirectory().getChildFile(juce::String(key) + ".ts");
+  if (cached.existsAsFile()) {
+    try {
+      auto optimized = std::make_shared<torch::jit::Module>(
+          load(cached.getFullPathName().toStdString()));
+      std::cout << "[ ] RAVE - Optimized model loaded from "
+                << cached.getFullPathName() << std::endl;
+      return optimized;
+    } catch (const c10::Error &e) {
+      // e.g. truncated by a crash, optimize again
+      std::cerr << "[-] RAVE - cannot load " << cached.getFullPathName()
+                << ", discarding it" << std::endl;
+      cached.deleteFile();
+    }
+  }
+
+  const double start = juce::Time::getMillisecondCounterHiRes();
+  auto optimized =
+      std::make_shared<torch::jit::Module>(optimize(module, methods, precision));
+  std::cout << "[ ] RAVE - Model optimized in "
+            << juce::Time::getMillisecondCounterHiRes() - start << " ms"
+            << std::endl;
+
+  // written aside then moved, as another process may be loading it
+  getCacheDirectory().createDirectory();
+  const juce::TemporaryFile temporary(cached);
+  try {
+    optimized->save(temporary.getFile().getFullPathName().toStdString());
+    if (!temporary.overwriteTargetFileWithTemporary())
+      std::cerr << "[-] RAVE - cannot write " << cached.getFullPathName()
+                << std::endl;
+  } catch (const c10::Error &e) {
+    std::cerr << e.what();
+    std::cerr << "[-] RAVE - cannot save the optimized model" << std::endl;
+  }
+  return optimized;
+}
+
+torch::jit::Module
+ModelCache::optimize(const torch::jit::Module &module,
+                     const std::vector<std::string> &methods,
+                     Precision precision) {
+  torch::jit::Module copy = module.clone();
+  copy.eval();
+  if (precision == Precision::bfloat16)
+    castWeightsToBFloat16(copy);
+  // freezing inlines the weights and attributes as constants, and drops the
+  // methods that are not preserved
+  torch::jit::Module frozen = torch::jit::freeze(copy, methods);
+  if (precision == Precision::int8) {
+    const int convolutions = quantizeConvolutions(frozen, methods);
+    TORCH_CHECK(convolutions > 0, "no convolution to quantize");
+    std::cout << "\tQuantized convolutions: " << convolutions << std::endl;
+  } else if (precision == Precision::bfloat16) {
+    castBoundaries(frozen, methods);
+  }
+  // folds conv / batch norm, fuses ops and picks the best backend for the
+  // convolutions, on forward and the given methods
+  std::vector<std::string> others;
+  for (const auto &method : methods)
+    if (method != "forward")
+      others.push_back(method);
+  return torch::jit::optimize_for_inference(frozen, others);
+}
+
+torch::jit::Module ModelCache::instantiate(const torch::jit::Module &module) {
+  c10::InferenceMode guard;
+  torch::jit::Module instance = module.clone();
+  shareParameters(instance, module);
+  return instance;
+}
+
+void ModelCache::shareParameters(torch::jit::Module &instance,
+                                 const torch::jit::Module &shared) {
+  for (const auto &param : shared.named_parameters(false))
+    instance.setattr(param.name, param.value);
+  // buffers hold the state, make sure they are not aliased whatever clone()
+  // did with them
+  for (const auto &buf : shared.named_buffers(false))
+    instance.setattr(buf.name, buf.value.clone());
+  for (const auto &child : shared.named_children()) {
+    torch::jit::Module instanceChild = instance.attr(child.name).toModule();
+    shareParameters(instanceChild, child.value);
+  }
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include "Precision.h"
+#include <JuceHeader.h>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <torch/script.h>
+#include <vector>
+
+// Process-wide registry of the loaded TorchScript modules, shared by every
+// plugin instance. Modules are keyed by the content of their file, so that
+// copies of the same model loaded from different places are only loaded
+// once, and they are freed when the last engine using them goes away.
+//
+// The shared module is never modified after loading: engines whose model
+// keeps state between calls (streaming models) run their own instance of it,
+// see instantiate().
+//
+// Stateless modules can also be frozen and optimized for inference, see
+// acquireOptimized(). The result is saved to the cache directory, so that
+// the optimization passes only run the first time a model is loaded with a
+// given version of libtorch.
+//
+// Model files are memory-mapped, and the weights of the loaded modules point
+// into the mapping rather than to a copy of their own: they are shared
+// through the page cache with every process loading the same file, until
+// written to. The mapping is copy-on-write, a write only copies the pages it
+// touches. Files must be replaced by moving a new one over them, not
+// rewritten in place, and on Windows not until every module mapping them is
+// freed.
+class ModelCache {
+public:
+  using ModulePtr = std::shared_ptr<torch::jit::Module>;
+
+  static ModelCache &getInstance();
+
+  // Loads the model or returns the already loaded copy of it. Throws
+  // c10::Error if the file cannot be loaded. Loads of different models run
+  // in parallel, loads of the same one wait for the first. Modules are only
+  // shared between loads of the same executor, a key for the settings their
+  // methods are compiled with, see ExecutorConfig.
+  ModulePtr acquire(const std::string &modelFile,
+                    const std::string &executor = {});
+
+  // Frozen and optimized copy of module, which was loaded from modelFile,
+  // keeping only the given methods, and computing in precision (see
+  // Precision). Loaded from the cache directory if it was optimized before.
+  // Throws c10::Error if the module cannot be optimized, or converted to
+  // precision.
+  ModulePtr acquireOptimized(const std::string &modelFile,
+                             const torch::jit::Module &module,
+                             const std::vector<std::string> &methods,
+                             Precision precision = Precision::float32,
+                             const std::string &executor = {});
+
+  // Where the optimized modules are saved, in the models directory
+  static juce::File getCacheDirectory();
+
+  // Copy of module with its own buffers, but sharing the parameters (and
+  // thus the memory of the weights) of the cached one
+  static torch::jit::Module instantiate(const torch::jit::Module &module);
+
+private:
+  ModelCache() = default;
+  static std::string contentKey(const std::string &modelFile);
+  // torch::jit::load, then the parameters and the tensor constants of the
+  // graphs are moved to the mapping of file. Falls back to the weights of
+  // torch::jit::load if the file cannot be mapped.
+  static torch::jit::Module load(const std::string &file);
+  // acquireOptimized, from the cache directory or optimized and saved there
+  static ModulePtr loadOptimized(const std::string &key,
+                                 const torch::jit::Module &module,
+                                 const std::vector<std::string> &methods,
+                                 Precision precision);
+  static torch::jit::Module optimize(const torch::jit::Module &module,
+                                     const std::vector<std::string> &methods,
+                                     Precision precision);
+  static void shareParameters(torch::jit::Module &instance,
+                              const torch::jit::Module &shared);
+  // The module of key if it is loaded, or the result of load, which only
+  // runs on the first thread asking for key, outside of the lock
+  ModulePtr getOrLoad(const std::string &key,
+                      const std::function<ModulePtr()> &load);
+
+  struct Entry {
+    std::weak_ptr<torch::jit::Module> module;
+    // valid while a thread loads the module, the others wait for it
+    std::shared_future<ModulePtr> loading;
+  };
+  // only held to look the entries up, never while loading
+  std::mutex _mutex;
+  std::map<std::string, Entry> _modules;
+
+  JUCE_DECLARE_NON_COPYABLE(ModelCache)
+};
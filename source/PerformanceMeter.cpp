@@ -0,0 +1,87 @@
+#include "PerformanceMeter.h"
+#include <algorithm>
+#include <vector>
+
+void PerformanceMeter::beginFrame() {
+  _current.fill(0.0);
+  _mark = juce::Time::getHighResolutionTicks();
+}
+
+void PerformanceMeter::lap(Stage stage) {
+  const juce::int64 now = juce::Time::getHighResolutionTicks();
+  _current[stage] +=
+      1000.0 * juce::Time::highResolutionTicksToSeconds(now - _mark);
+  _mark = now;
+}
+
+double PerformanceMeter::endFrame(double durationSeconds) {
+  const juce::uint32 slot = _written.load(std::memory_order_relaxed) % history;
+  double frameMs = 0;
+  for (int stage = 0; stage < numStages; stage++) {
+    _ms[slot][stage].store((float)_current[stage], std::memory_order_relaxed);
+    frameMs += _current[stage];
+  }
+  _ms[slot][total].store((float)frameMs, std::memory_order_relaxed);
+  _durationMs[slot].store((float)(1000.0 * durationSeconds),
+                          std::memory_order_relaxed);
+  _written.fetch_add(1, std::memory_order_release);
+  if (frameMs > 1000.0 * durationSeconds)
+    _overruns.fetch_add(1, std::memory_order_relaxed);
+  return durationSeconds > 0 ? frameMs / (1000.0 * durationSeconds) : 0.0;
+}
+
+PerformanceMeter::Stats PerformanceMeter::getStats() const {
+  Stats stats;
+  stats.overruns = _overruns.load(std::memory_order_relaxed);
+  const int frames =
+      (int)std::min<juce::uint32>(_written.load(std::memory_order_acquire),
+                                  (juce::uint32)history);
+  stats.frames = frames;
+  if (frames == 0)
+    return stats;
+
+  std::vector<float> values((size_t)frames);
+  for (int column = 0; column <= total; column++) {
+    for (int i = 0; i < frames; i++)
+      values[(size_t)i] = _ms[(size_t)i][(size_t)column].load(
+          std::memory_order_relaxed);
+    std::sort(values.begin(), values.end());
+    stats.p50Ms[(size_t)column] = values[(size_t)(frames - 1) / 2];
+    stats.p99Ms[(size_t)column] = values[(size_t)((frames - 1) * 99 / 100)];
+    stats.maxMs[(size_t)column] = values.back();
+  }
+
+  double computed = 0, duration = 0;
+  for (int i = 0; i < frames; i++) {
+    const double frameMs = _ms[(size_t)i][total].load(std::memory_order_relaxed);
+    const double frameDuration =
+        _durationMs[(size_t)i].load(std::memory_order_relaxed);
+    computed += frameMs;
+    duration += frameDuration;
+    if (frameDuration > 0)
+      stats.peakRealtimeFactor =
+          std::max(stats.peakRealtimeFactor, frameMs / frameDuration);
+  }
+  stats.realtimeFactor = duration > 0 ? computed / duration : 0.0;
+  return stats;
+}
+
+void PerformanceMeter::reset() {
+  _written.store(0, std::memory_order_release);
+  _overruns.store(0, std::memory_order_relaxed);
+}
+
+const char *PerformanceMeter::getStageName(int stage) {
+  switch (stage) {
+  case encode:
+    return "encode";
+  case latent:
+    return "latent";
+  case decode:
+    return "decode";
+  case output:
+    return "output";
+  default:
+    return "total";
+  }
+}
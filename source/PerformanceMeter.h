@@ -0,0 +1,52 @@
+#pragma once
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+
+// Inference time of the last frames, stage by stage. Written by the thread
+// performing the frames, read from anywhere: every value is an atomic and
+// nothing locks, a reader racing the writer at worst mixes two frames.
+class PerformanceMeter {
+public:
+  // encode also covers prior sampling, latent the scale / bias, jitter and
+  // width, output the crossfade and the copy to the output ring
+  enum Stage { encode = 0, latent, decode, output, numStages };
+  static constexpr int total = numStages;
+  static constexpr int history = 256;
+
+  struct Stats {
+    // per stage, then the whole frame at index total, in ms
+    std::array<double, numStages + 1> p50Ms{};
+    std::array<double, numStages + 1> p99Ms{};
+    std::array<double, numStages + 1> maxMs{};
+    // computation time over the audio duration of the frames, on average
+    // and for the worst frame
+    double realtimeFactor = 0;
+    double peakRealtimeFactor = 0;
+    // frames in the statistics, at most history
+    int frames = 0;
+    // frames computed slower than real time since the last reset
+    int overruns = 0;
+  };
+
+  // Writer side: beginFrame, then lap at the end of each stage (a stage can
+  // be lapped several times, it adds up), then endFrame with the audio
+  // duration of the frame. Returns the frame's real-time factor.
+  void beginFrame();
+  void lap(Stage stage);
+  double endFrame(double durationSeconds);
+
+  Stats getStats() const;
+  void reset();
+  static const char *getStageName(int stage);
+
+private:
+  // writer only
+  juce::int64 _mark = 0;
+  std::array<double, numStages> _current{};
+
+  std::array<std::array<std::atomic<float>, numStages + 1>, history> _ms{};
+  std::array<std::atomic<float>, history> _durationMs{};
+  std::atomic<juce::uint32> _written{0};
+  std::atomic<int> _overruns{0};
+};
@@ -1,5 +1,6 @@
 #include "PluginEditor.h"
 #include "PluginProcessor.h"
+#include "Tracer.h"
 
 RaveAPEditor::RaveAPEditor(RaveAP &p, AudioProcessorValueTreeState &vts)
     : AudioProcessorEditor(&p), ChangeListener(), _lightLookAndFeel(),
@@ -49,8 +50,8 @@ RaveAPEditor::RaveAPEditor(RaveAP &p, AudioProcessorValueTreeState &vts)
   _foldablePanel.connectVTS(vts);
 
   // link to model
-  p._rave->addChangeListener(this);
-  _modelPanel.setModel(p._rave.get());
+  p.addEngineListener(this);
+  _modelPanel.setModel(p.getEngine());
 
   // Model manager button stuff
   _header._modelManagerButton.onClick = [this]() {
@@ -72,16 +73,19 @@ RaveAPEditor::RaveAPEditor(RaveAP &p, AudioProcessorValueTreeState &vts)
   addAndMakeVisible(_modelPanel);
   addAndMakeVisible(_foldablePanel);
   addAndMakeVisible(_console);
+  // the status line, right-click it for the thread settings
+  _console.addMouseListener(this, false);
+  _console.setFont(Font(12.f));
   addChildComponent(_modelExplorer);
 
   setResizable(false, false);
   getConstrainer()->setMinimumSize(996, 560);
   setSize(996, 560);
-  // startTimer(100.);
+  startTimer(500);
 
 }
 
-RaveAPEditor::~RaveAPEditor() {}
+RaveAPEditor::~RaveAPEditor() { audioProcessor.removeEngineListener(this); }
 
 void RaveAPEditor::importModel() {
   _fc.reset(new FileChooser(
@@ -111,12 +115,167 @@ void RaveAPEditor::importModel() {
       });
 }
 
-/*
 void RaveAPEditor::timerCallback() {
-  //_console.setText(String(audioProcessor.getLatencySamples()),
-juce::dontSendNotification);
+  // load of the last frames: real-time factor, then p50 / p99 / max per stage
+  const auto stats = audioProcessor.getPerformanceStats();
+  String text;
+  if (stats.frames == 0) {
+    text = "No frame performed yet";
+  } else {
+    text = "RTF " + String(stats.realtimeFactor, 2) + " (max " +
+           String(stats.peakRealtimeFactor, 2) + ") | ms p50/p99/max";
+    for (int stage = 0; stage <= PerformanceMeter::total; stage++)
+      text += String(" ") + PerformanceMeter::getStageName(stage) + " " +
+              String(stats.p50Ms[stage], 1) + "/" +
+              String(stats.p99Ms[stage], 1) + "/" +
+              String(stats.maxMs[stage], 1);
+    text += " | " + String(stats.overruns) + " overruns, " +
+            String(audioProcessor.getMissedFrames()) + " missed frames";
+  }
+  _console.setText(text, juce::dontSendNotification);
+  _console.setTooltip("Inference: " +
+                      audioProcessor.getThreadReport().toString() +
+                      "\nRight-click for the thread settings");
+}
+
+void RaveAPEditor::mouseDown(const MouseEvent &event) {
+  if (event.eventComponent == &_console && event.mods.isPopupMenu())
+    showThreadMenu();
+}
+
+void RaveAPEditor::showThreadMenu() {
+  auto settings = audioProcessor.getThreadSettings();
+  const auto effective = settings.over(ThreadSettings::getGlobal());
+  const int cores = SystemStats::getNumCpus();
+
+  PopupMenu threads;
+  threads.addItem("Default", true, !settings.intraOpThreads, [this]() {
+    auto s = audioProcessor.getThreadSettings();
+    s.intraOpThreads.reset();
+    audioProcessor.setThreadSettings(s);
+  });
+  for (int n = 1; n <= cores; n *= 2)
+    threads.addItem(String(n), true, settings.intraOpThreads == n, [this, n]() {
+      auto s = audioProcessor.getThreadSettings();
+      s.intraOpThreads = n;
+      audioProcessor.setThreadSettings(s);
+    });
+
+  PopupMenu pinning;
+  pinning.addItem("Not pinned", true, effective.affinityMask.value_or(0) == 0,
+                  [this]() {
+                    auto s = audioProcessor.getThreadSettings();
+                    s.affinityMask = 0u;
+                    audioProcessor.setThreadSettings(s);
+                  });
+  // masks are 32 bits wide, see ThreadSettings
+  for (int core = 0; core < jmin(cores, 32); core++) {
+    const juce::uint32 mask = 1u << core;
+    pinning.addItem("Core " + String(core), true,
+                    effective.affinityMask == mask, [this, mask]() {
+                      auto s = audioProcessor.getThreadSettings();
+                      s.affinityMask = mask;
+                      audioProcessor.setThreadSettings(s);
+                    });
+  }
+
+  PopupMenu menu;
+  menu.addSectionHeader(audioProcessor.getThreadReport().toString());
+  menu.addItem("Reset statistics",
+               [this]() { audioProcessor.resetPerformanceStats(); });
+  // traces cover every instance of the process
+  auto &tracer = Tracer::getInstance();
+  if (tracer.isEnabled()) {
+    menu.addItem("Stop trace", []() {
+      auto &tracer = Tracer::getInstance();
+      const auto result = tracer.stop();
+      AlertWindow::showAsync(
+          MessageBoxOptions()
+              .withIconType(result.wasOk() ? MessageBoxIconType::InfoIcon
+                                           : MessageBoxIconType::WarningIcon)
+              .withTitle("Trace")
+              .withMessage(result.wasOk()
+                               ? "Written to " +
+                                     tracer.getFile().getFullPathName() +
+                                     "\nOpen it in chrome://tracing or "
+                                     "ui.perfetto.dev"
+                               : result.getErrorMessage())
+              .withButton("OK"),
+          nullptr);
+    });
+  } else {
+    menu.addItem("Start trace", []() {
+      Tracer::getInstance().start(Tracer::getDefaultFile(), false);
+    });
+    menu.addItem("Start trace with torch ops", []() {
+      Tracer::getInstance().start(Tracer::getDefaultFile(), true);
+    });
+  }
+  // per model, reloads it
+  auto engine = audioProcessor.getEngine();
+  if (engine != nullptr && engine->isLoaded()) {
+    const std::string model = engine->getModelPath().toStdString();
+    const Precision selected = audioProcessor.getPrecision(model);
+    juce::PopupMenu precisions;
+    for (auto precision :
+         {Precision::float32, Precision::int8, Precision::bfloat16}) {
+      juce::String name = getPrecisionName(precision);
+      if (precision == selected && precision != engine->getPrecision())
+        name << " (not supported by this model)";
+      else if (precision == engine->getPrecision() &&
+               precision != Precision::float32)
+        name << " (deviation "
+             << juce::String(engine->getPrecisionDeviation() * 100.0, 2)
+             << "%)";
+      else if (!isPrecisionSupported(precision))
+        name << " (not supported by this CPU)";
+      // streaming models keep running as exported
+      const bool enabled =
+          precision == Precision::float32 ||
+          (!engine->isStreaming() && isPrecisionSupported(precision));
+      precisions.addItem(name, enabled, precision == selected,
+                         [this, model, precision]() {
+                           audioProcessor.setPrecision(model, precision);
+                         });
+    }
+    menu.addSeparator();
+    menu.addSectionHeader("Model");
+    menu.addSubMenu("Precision", precisions);
+  }
+  menu.addSeparator();
+  menu.addSectionHeader("Inference thread");
+  menu.addSubMenu("Torch threads", threads);
+  menu.addSubMenu("Pin to", pinning);
+  const bool realtime = effective.realtimePriority.value_or(false);
+  menu.addItem("Real-time priority", true, realtime, [this, realtime]() {
+    auto s = audioProcessor.getThreadSettings();
+    s.realtimePriority = !realtime;
+    audioProcessor.setThreadSettings(s);
+  });
+  // global, split between the instances leaving torch threads to default
+  PopupMenu budget;
+  const int budgetCores = ThreadBudget::getInstance().getBudget();
+  for (int n = 1; n < cores * 2; n *= 2) {
+    const int value = jmin(n, cores);
+    budget.addItem(String(value), true, budgetCores == value, [value]() {
+      auto s = ThreadSettings::getGlobal();
+      s.threadBudget = value;
+      ThreadSettings::setGlobal(s);
+      ThreadBudget::getInstance().rebalance(true);
+    });
+  }
+  menu.addSubMenu("Cores for all instances", budget);
+  menu.addSeparator();
+  menu.addItem("Save as defaults", [this]() {
+    // the inter-op pool size is only ever set in the file
+    ThreadSettings::setGlobal(
+        audioProcessor.getThreadSettings().over(ThreadSettings::getGlobal()));
+  });
+  menu.addItem("Use defaults", [this]() {
+    audioProcessor.setThreadSettings(ThreadSettings());
+  });
+  menu.showMenuAsync(PopupMenu::Options().withTargetComponent(&_console));
 }
-*/
 
 void RaveAPEditor::resized() {
   // Child components should not handle margins, do it here
@@ -152,12 +311,15 @@ void RaveAPEditor::paint(juce::Graphics &g) {
 void RaveAPEditor::log(String /*str*/) {}
 
 void RaveAPEditor::changeListenerCallback(ChangeBroadcaster * /*source*/) {
-  if (audioProcessor._rave != nullptr) {
+  // the processor swapped its engine
+  auto engine = audioProcessor.getEngine();
+  _modelPanel.setModel(engine);
+  if (engine != nullptr) {
     // std::cout << "set prior in changeListenerCallback to" <<
-    // audioProcessor._rave->hasPrior() << std::endl;
-    //_modelPanel.setPriorEnabled(audioProcessor._rave->hasPrior());
-    _foldablePanel.setBufferSizeRange(
-        audioProcessor._rave->getValidBufferSizes());
+    // engine->hasPrior() << std::endl;
+    //_modelPanel.setPriorEnabled(engine->hasPrior());
+    _foldablePanel.setBufferSizeRange(engine->getValidBufferSizes());
+    _foldablePanel.setStreaming(engine->isStreaming());
   }
 }
 
@@ -15,6 +15,7 @@
 
 class RaveAPEditor : public juce::AudioProcessorEditor,
                      public juce::ChangeListener,
+                     public juce::Timer,
                      public juce::URL::DownloadTaskListener {
 public:
   RaveAPEditor(RaveAP &, AudioProcessorValueTreeState &);
@@ -24,6 +25,8 @@ public:
   void resized() override;
   void log(String str);
   void changeListenerCallback(ChangeBroadcaster *source) override;
+  void timerCallback() override;
+  void mouseDown(const MouseEvent &event) override;
 
   void finished(URL::DownloadTask *task, bool success) override;
   void progress(URL::DownloadTask *task, int64 bytesDownloaded,
@@ -36,6 +39,7 @@ private:
   void detectAvailableModels();
   void importModel();
   String getApiRoot();
+  void showThreadMenu();
 
   File _modelsDirPath;
   std::unique_ptr<FileChooser> _fc;
@@ -52,6 +56,7 @@ private:
   // Model Manager window
   ModelExplorer _modelExplorer;
   Label _console;
+  TooltipWindow _tooltipWindow{this, 700};
 
   Image _bgFull;
 
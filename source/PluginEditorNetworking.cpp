@@ -1,6 +1,21 @@
 #include "PluginEditor.h"
 
 void RaveAPEditor::finished(URL::DownloadTask *task, bool success) {
+  // downloaded aside, then moved over the model, which may be mapped by a
+  // loaded one (see ModelCache)
+  const File part = task->getTargetLocation();
+  File target = part.withFileExtension("");
+  if (success && !part.moveFileTo(target)) {
+    // Windows does not let a mapped file be replaced, keep both
+    target = target.getParentDirectory().getNonexistentChildFile(
+        target.getFileNameWithoutExtension(), ".ts");
+    success = part.moveFileTo(target);
+    if (success)
+      std::cout << "[ ] Network - Model in use, saved as "
+                << target.getFullPathName() << std::endl;
+  }
+  if (!success)
+    part.deleteFile();
   if (success) {
     std::cout << "[+] Network - Model downloaded" << std::endl;
     // AlertWindow::showAsync(MessageBoxOptions()
@@ -49,7 +64,7 @@ void RaveAPEditor::downloadModelFromAPI() {
   // TODO: Clean up the path handling, avoid using String concatenation for
   // that
   String outputFilePath = _modelsDirPath.getFullPathName() + String("/") +
-                          modelName + String(".ts");
+                          modelName + String(".ts.part");
   File outputFile = File(outputFilePath);
   std::unique_ptr<URL::DownloadTask> res = url.downloadToFile(
       outputFile, URL::DownloadTaskOptions().withListener(this));
@@ -10,14 +10,11 @@ RaveAP::RaveAP()
               .withOutput("Output", juce::AudioChannelSet::stereo(), true)),
       _avts(*this, nullptr, Identifier("RAVEValueTree"),
             createParameterLayout()),
-      _loadedModelName(""), _computeThread(nullptr), _dryWetMixerEffect(BUFFER_LENGTH)
+      _loadedModelName(""), _dryWetMixerEffect(MAX_WET_LATENCY)
  #endif
 {
-  _inBuffer = std::make_unique<circular_buffer<float, float>[]>(1);
-  _outBuffer = std::make_unique<circular_buffer<float, float>[]>(2);
-  _inModel.push_back(std::make_unique<float[]>(BUFFER_LENGTH));
-  _outModel.push_back(std::make_unique<float[]>(BUFFER_LENGTH));
-  _outModel.push_back(std::make_unique<float[]>(BUFFER_LENGTH));
+  _inBuffer = std::make_unique<ring_buffer<float>[]>(1);
+  _outBuffer = std::make_unique<ring_buffer<float>[]>(2);
 
   _inputGainValue = _avts.getRawParameterValue(rave_parameters::input_gain);
   _thresholdValue = _avts.getRawParameterValue(rave_parameters::input_thresh);
@@ -40,8 +37,19 @@ RaveAP::RaveAP()
   }
   _latencyMode = _avts.getRawParameterValue(rave_parameters::latency_mode);
   _priorTemperature = _avts.getRawParameterValue(rave_parameters::prior_temperature);
+  _batchedInference =
+      _avts.getRawParameterValue(rave_parameters::batched_inference);
+  _latencyAuto = _avts.getRawParameterValue(rave_parameters::latency_auto);
+  _frameExponent.store((int)_latencyMode->load());
   _engineThreadPool = std::make_unique<ThreadPool>(1);
-  _rave.reset(new RAVE());
+  _tuningThreadPool = std::make_unique<ThreadPool>(1);
+  // no engine until the first model load, which also sets libtorch up (see
+  // TorchRuntime): an engine runs torch code from its construction
+  _inferenceWorker =
+      std::make_unique<InferenceWorker>([this]() { modelPerform(); });
+  ThreadBudget::getInstance().join(_threadShare);
+  applyThreadSettings();
+  _inferenceWorker->start();
 
   _avts.addParameterListener(rave_parameters::input_gain, this);
   _avts.addParameterListener(rave_parameters::input_thresh, this);
@@ -52,19 +60,33 @@ RaveAP::RaveAP()
   _avts.addParameterListener(rave_parameters::latency_mode, this);
   _dryWetMixerEffect.setMixingRule(juce::dsp::DryWetMixingRule::balanced);
   _editorReady = false;
+  startTimer(500);
 }
 
 RaveAP::~RaveAP() {
-  if (_computeThread)
-    _computeThread->join();
+  stopTimer();
+  // a model may be loading, and the job swaps it into this object
+  _engineThreadPool->removeAllJobs(true, 5000);
+  _tuningThreadPool->removeAllJobs(true, 5000);
+  // the worker calls back into this object, stop it before anything else goes
+  _inferenceWorker.reset();
+  ThreadBudget::getInstance().leave(_threadShare);
 }
 
 void RaveAP::prepareToPlay(double sampleRate, int samplesPerBlock) {
   _sampleRate = sampleRate;
-  _inBuffer[0].initialize(BUFFER_LENGTH);
-  _outBuffer[0].initialize(BUFFER_LENGTH);
-  _outBuffer[1].initialize(BUFFER_LENGTH);
+  _hostBlockSize = samplesPerBlock;
+  _offline.store(isNonRealtime());
+  if (_offline.load())
+    std::cout << "[ ] - rendering offline" << std::endl;
+  auto engine = getEngine();
+  prepareResampling(engine != nullptr ? engine->getSamplingRate() : 0.0);
+  resetPipeline();
+  _wetBuffer.setSize(2, samplesPerBlock);
   _smoothedFadeInOut.reset(sampleRate, 0.2);
+  _smoothedReconfigure.reset(sampleRate, 0.02);
+  _smoothedReconfigure.setCurrentAndTargetValue(1.f);
+  _reconfigureHold = 0;
   juce::dsp::ProcessSpec specs = {
       sampleRate, static_cast<juce::uint32>(samplesPerBlock), 2};
   _inputGainEffect.prepare(specs);
@@ -78,7 +100,132 @@ void RaveAP::prepareToPlay(double sampleRate, int samplesPerBlock) {
   _compressorEffect.setThreshold(_thresholdValue->load());
   _outputGainEffect.setGainDecibels(_outputGainValue->load());
   _dryWetMixerEffect.setWetMixProportion(_dryWetValue->load() / 100.f);
-  setLatencySamples(pow(2, *_latencyMode));
+  updateStreamingMode(engine.get());
+}
+
+// Everything downstream of the resamplers runs at the model rate: the rings,
+// the frames and the sample counters aligning the output with the input.
+void RaveAP::prepareResampling(double modelSampleRate) {
+  _modelSampleRate = modelSampleRate > 0 ? modelSampleRate : _sampleRate;
+  _inputResampler.prepare(_sampleRate, _modelSampleRate);
+  _outputResamplers[0].prepare(_modelSampleRate, _sampleRate);
+  _outputResamplers[1].prepare(_modelSampleRate, _sampleRate);
+  if (_inputResampler.isActive())
+    std::cout << "[ ] - resampling between " << _sampleRate << " Hz and "
+              << _modelSampleRate << " Hz" << std::endl;
+  // model rate scratch for one host block, larger blocks are split
+  const int modelBlockSize = getModelBlockSize() + 2;
+  _resampledInput.setSize(1, modelBlockSize);
+  _modelOutput.setSize(2, modelBlockSize);
+}
+
+void RaveAP::resetPipeline() {
+  // the worker reads and writes the rings, keep it away while they are rebuilt
+  _inferenceWorker->stop();
+  // frames are accessed in place, so any frame must be contiguous, and a
+  // couple of them can be pending on each side
+  _inBuffer[0].initialize(4 * BUFFER_LENGTH, BUFFER_LENGTH);
+  _outBuffer[0].initialize(4 * BUFFER_LENGTH, BUFFER_LENGTH);
+  _outBuffer[1].initialize(4 * BUFFER_LENGTH, BUFFER_LENGTH);
+  _frameQueue.clear();
+  _inputPushed = 0;
+  _frameStart = 0;
+  _outputPlayed = 0;
+  _outputConsumed = 0;
+  _inputDropped = 0;
+  // nothing queued yet, the latency mode applies straight away
+  _frameExponent.store((int)_latencyMode->load());
+  _inputResampler.reset();
+  _outputResamplers[0].reset();
+  _outputResamplers[1].reset();
+  _inferenceWorker->start();
+}
+
+void RaveAP::updateModelSampleRate(RAVE &engine) {
+  const double modelSampleRate =
+      engine.getSamplingRate() > 0 ? engine.getSamplingRate() : _sampleRate;
+  if (_sampleRate <= 0 || modelSampleRate == _modelSampleRate)
+    return;
+  // the queued audio is at the previous rate, start over
+  suspendProcessing(true);
+  prepareResampling(modelSampleRate);
+  resetPipeline();
+  updateStreamingMode(&engine);
+  suspendProcessing(false);
+}
+
+ThreadSettings RaveAP::getThreadSettings() const {
+  return ThreadSettings::fromValueTree(
+      _avts.state.getChildWithName(ThreadSettings::treeType));
+}
+
+void RaveAP::setThreadSettings(const ThreadSettings &settings) {
+  auto tree = _avts.state.getChildWithName(ThreadSettings::treeType);
+  if (tree.isValid())
+    _avts.state.removeChild(tree, nullptr);
+  _avts.state.appendChild(settings.toValueTree(), nullptr);
+  applyThreadSettings();
+}
+
+void RaveAP::applyThreadSettings() {
+  const auto settings = getThreadSettings().over(ThreadSettings::getGlobal());
+  _inferenceWorker->setThreadSettings(settings);
+  ThreadBudget::getInstance().setFixedThreads(
+      _threadShare, settings.intraOpThreads.value_or(0));
+}
+
+ThreadReport RaveAP::getThreadReport() const {
+  auto report = _inferenceWorker->getThreadReport();
+  auto &budget = ThreadBudget::getInstance();
+  // the worker reports when its settings are applied, the share may have
+  // changed since
+  if (_threadShare.getShare() > 0)
+    report.intraOpThreads = _threadShare.getShare();
+  report.budget = budget.getBudget();
+  report.activeInstances = budget.getActiveCount();
+  return report;
+}
+
+namespace {
+// <PRECISION><MODEL name="model.ts" precision="bfloat16"/>...</PRECISION>,
+// by file name so that it follows the model from one machine to another
+const juce::Identifier precisionId{"PRECISION"};
+const juce::Identifier modelId{"MODEL"};
+const juce::Identifier nameId{"name"};
+const juce::Identifier precisionNameId{"precision"};
+} // namespace
+
+Precision RaveAP::getPrecision(const std::string &modelFile) const {
+  const juce::String name = juce::File(modelFile).getFileName();
+  const auto model = _avts.state.getChildWithName(precisionId)
+                         .getChildWithProperty(nameId, name);
+  return model.isValid()
+             ? getPrecisionFromName(model[precisionNameId].toString())
+             : Precision::float32;
+}
+
+void RaveAP::setPrecision(const std::string &modelFile, Precision precision) {
+  auto models = _avts.state.getOrCreateChildWithName(precisionId, nullptr);
+  const juce::String name = juce::File(modelFile).getFileName();
+  auto model = models.getChildWithProperty(nameId, name);
+  if (!model.isValid()) {
+    model = juce::ValueTree(modelId);
+    model.setProperty(nameId, name, nullptr);
+    models.appendChild(model, nullptr);
+  }
+  model.setProperty(precisionNameId, getPrecisionName(precision), nullptr);
+  if (modelFile == _loadedModelName) {
+    _loadedModelName.clear();
+    updateEngine(modelFile);
+  }
+}
+
+int RaveAP::getModelBlockSize() { return getModelBlockSize(_modelSampleRate); }
+
+int RaveAP::getModelBlockSize(double modelSampleRate) {
+  if (_sampleRate <= 0 || modelSampleRate <= 0)
+    return _hostBlockSize;
+  return (int)std::ceil(_hostBlockSize * modelSampleRate / _sampleRate);
 }
 
 void RaveAP::releaseResources() {
@@ -134,6 +281,11 @@ AudioProcessorValueTreeState::ParameterLayout RaveAP::createParameterLayout() {
   params.push_back(std::make_unique<AudioParameterFloat>(
       rave_parameters::prior_temperature, rave_parameters::prior_temperature,
       0.f, 5.f, 1.f));
+  params.push_back(std::make_unique<AudioParameterBool>(
+      rave_parameters::batched_inference, rave_parameters::batched_inference,
+      false));
+  params.push_back(std::make_unique<AudioParameterBool>(
+      rave_parameters::latency_auto, rave_parameters::latency_auto, false));
 
   String current_name;
   for (size_t i = 0; i < AVAILABLE_DIMS; i++) {
@@ -1,18 +1,33 @@
 #pragma once
 
+#include "AtomicSharedPtr.h"
 #include "Rave.h"
-#include "CircularBuffer.h"
+#include "RingBuffer.h"
 #include "EngineUpdater.h"
+#include "ExecutorTuner.h"
+#include "FrameQueue.h"
+#include "InferenceWorker.h"
+#include "LatencyGovernor.h"
+#include "PerformanceMeter.h"
+#include "RealtimeChecker.h"
+#include "Resampler.h"
+#include "ThreadBudget.h"
+#include "ThreadSettings.h"
+#include "TorchRuntime.h"
 #include <JuceHeader.h>
 #include <algorithm>
 #include <torch/script.h>
 #include <torch/torch.h>
 
 #define EPSILON 0.0000001
+// longest latency the dry signal can be delayed by, in host samples
+#define MAX_WET_LATENCY (8 * BUFFER_LENGTH)
 #define DEBUG 0
 
 const size_t AVAILABLE_DIMS = 8;
 const juce::StringArray channel_modes = {"L", "R", "L + R"};
+// values of the channel_mode parameter, in the order of channel_modes
+enum class ChannelMode : int { left = 1, right, both };
 
 namespace rave_parameters {
 const String model_selection{"model_selection"};
@@ -30,6 +45,8 @@ const String latent_bias{"latent_bias"};
 const String latency_mode{"latency_mode"};
 const String use_prior{"use_prior"};
 const String prior_temperature{"prior_temperature"};
+const String batched_inference{"batched_inference"};
+const String latency_auto{"latency_auto"};
 } // namespace rave_parameters
 
 namespace rave_ranges {
@@ -54,7 +71,8 @@ class NAAudioParameterInt: public juce::AudioParameterInt {
 
 
 class RaveAP : public juce::AudioProcessor,
-               public juce::AudioProcessorValueTreeState::Listener {
+               public juce::AudioProcessorValueTreeState::Listener,
+               private juce::Timer {
   // WARNING: As we do not implement processBlock() without parameters like in:
   // https://docs.juce.com/master/classAudioProcessor.html#abbac77f68ba047cf60c4bc97326dcb58
   // we explicitely authorize the use of AudioProcessor's processBlock
@@ -72,7 +90,19 @@ public:
   bool isBusesLayoutSupported(const BusesLayout &layouts) const override;
 #endif
   void processBlock(juce::AudioBuffer<float> &, juce::MidiBuffer &) override;
-  void modelPerform();
+  void modelPerform(int maxBatch = 1);
+  // Frame size in use. A latency mode change only applies once the output
+  // faded out, see processBlock; getTargetFrameSize is the one it goes to.
+  int getFrameSize();
+  int getTargetFrameSize();
+  // Frame size the processor would run engine at once swapped in, leaving
+  // the processor as it is
+  int getFrameSizeFor(RAVE &engine);
+  // at the model rate, for the frame size in use
+  int getPipelineLatency();
+  // in host samples, for the target frame size
+  int getReportedLatency();
+  bool isStreaming() const { return _streamingFrameSize.load() > 0; }
   void detectAvailableModels();
   juce::AudioProcessorEditor *createEditor() override;
   bool hasEditor() const override;
@@ -94,13 +124,53 @@ public:
   auto mute() -> void;
   auto unmute() -> void;
   auto getIsMuted() -> const bool;
-  void updateBufferSizes();
+  // Moves latency_mode into the range of engine, and the streaming frame
+  // size to it. Only for the engine playing, see swapEngine.
+  void updateBufferSizes(RAVE &engine);
+  // nullptr before the first model is loaded
+  void updateStreamingMode(RAVE *engine);
+  // Restarts the pipeline if engine does not run at the current model rate
+  void updateModelSampleRate(RAVE &engine);
+
+  // The engine performing the frames. It is replaced as a whole when a new
+  // model is loaded, and whoever got it keeps a valid engine for as long as
+  // they hold the pointer.
+  std::shared_ptr<RAVE> getEngine() const { return _rave.load(); }
+  // Publishes engine and returns the previous one
+  std::shared_ptr<RAVE> swapEngine(std::shared_ptr<RAVE> engine);
+  // Drops the engine the worker handed back after a swap, if any, so that a
+  // model is never freed on the worker. Loader and message threads.
+  void releaseRetiredEngine();
+  void addEngineListener(juce::ChangeListener *listener);
+  void removeEngineListener(juce::ChangeListener *listener);
 
   void updateEngine(const std::string modelFile);
+  // Measures the best executor settings for the model in the background,
+  // see ExecutorTuneJob
+  void tuneExecutor(const std::string &modelFile, Precision precision);
+  // Precision the model is to compute in, see Precision. Set per model and
+  // saved with the instance.
+  Precision getPrecision(const std::string &modelFile) const;
+  // Reloads the model if it is the one playing
+  void setPrecision(const std::string &modelFile, Precision precision);
   std::string capitalizeFirstLetter(std::string text);
   float getAmplitude(float *buffer, size_t len);
+  // Threading of the inference, see ThreadSettings. The instance settings
+  // only hold what this instance overrides, and are saved with its state.
+  ThreadSettings getThreadSettings() const;
+  void setThreadSettings(const ThreadSettings &settings);
+  // Reapplies the global settings where this instance does not override them,
+  // and takes a share of the thread budget if neither sets torch's threads
+  void applyThreadSettings();
+  ThreadReport getThreadReport() const;
+  // timing of the last frames performed, stage by stage
+  PerformanceMeter::Stats getPerformanceStats() const {
+    return _performanceMeter.getStats();
+  }
+  void resetPerformanceStats() { _performanceMeter.reset(); }
+  int getMissedFrames() const { return _missedFrames.load(); }
+  int getLateBlocks() const { return _lateBlocks.load(); }
 
-  std::unique_ptr<RAVE> _rave;
   float _inputAmplitudeL;
   float _inputAmplitudeR;
   float _outputAmplitudeL;
@@ -113,17 +183,84 @@ private:
   mutable CriticalSection _engineUpdateMutex;
   juce::AudioProcessorValueTreeState _avts;
   std::unique_ptr<juce::ThreadPool> _engineThreadPool;
+  // apart, so that loading a model does not wait for a tuning
+  std::unique_ptr<juce::ThreadPool> _tuningThreadPool;
   std::string _loadedModelName;
+  atomic_shared_ptr<RAVE> _rave;
+  // bumped by swapEngine, so that the worker only reloads _rave when needed
+  std::atomic<int> _engineEpoch{0};
+  // tells the editor the engine was replaced
+  juce::ChangeBroadcaster _engineBroadcaster;
 
   /*
-   *Allocate some memory to use as the circular_buffer storage
-   *for each of the circular_buffer types to be created
+   *Allocate some memory to use as the ring_buffer storage
+   *for each of the ring_buffer types to be created
    */
   double _sampleRate = 0;
-  std::unique_ptr<circular_buffer<float, float>[]> _inBuffer;
-  std::unique_ptr<circular_buffer<float, float>[]> _outBuffer;
-  std::vector<std::unique_ptr<float[]>> _inModel, _outModel;
-  std::unique_ptr<std::thread> _computeThread;
+  int _hostBlockSize = 0;
+  // frame size used with streaming models, 0 when latency_mode applies
+  std::atomic<int> _streamingFrameSize{0};
+  // latency mode in use, which follows latency_mode between two fades of the
+  // output: fading out, holding the silence of a latency increase, fading in
+  std::atomic<int> _frameExponent{0};
+  LinearSmoothedValue<float> _smoothedReconfigure;
+  int _reconfigureHold = 0;
+  // the dry signal is to be delayed to a new latency, by the audio thread
+  std::atomic<bool> _wetLatencyChanged{false};
+  // auto latency: worst inference load since the governor last looked at it,
+  // in proportion of the frames' duration
+  std::atomic<float> _peakLoad{0.f};
+  // written by the thread performing the frames
+  PerformanceMeter _performanceMeter;
+  LatencyGovernor _latencyGovernor;
+  int _governorMissedFrames = 0;
+  int _governorEpoch = -1;
+  // Set when the host renders offline, in prepareToPlay or by processBlock
+  // if the host switches without preparing again: frames are then performed
+  // inline in processBlock, never dropped, and batched when the model allows
+  // it
+  std::atomic<bool> _offline{false};
+  std::atomic<bool> _offlineBatching{false};
+  std::unique_ptr<ring_buffer<float>[]> _inBuffer;
+  std::unique_ptr<ring_buffer<float>[]> _outBuffer;
+  // Sample counters of the audio thread, used to keep the model output
+  // aligned with its input (see processBlock)
+  int64_t _inputPushed = 0;
+  int64_t _frameStart = 0;
+  int64_t _outputPlayed = 0;
+  int64_t _outputConsumed = 0;
+  int64_t _inputDropped = 0;
+  // frames handed over from processBlock to the inference worker
+  FrameQueue _frameQueue;
+  // wet signal scratch, sized in prepareToPlay
+  juce::AudioBuffer<float> _wetBuffer;
+  // Conversion between the host rate and the model's. The counters above and
+  // the rings are at the model rate.
+  double _modelSampleRate = 0;
+  Resampler _inputResampler;
+  Resampler _outputResamplers[2];
+  juce::AudioBuffer<float> _resampledInput;
+  juce::AudioBuffer<float> _modelOutput;
+  std::unique_ptr<InferenceWorker> _inferenceWorker;
+  // this instance's share of the process' cores, applied to torch's threads
+  // by whichever thread performs the frames
+  ThreadBudget::Participant _threadShare;
+  // Worker side copies of the engine: the one in use, and the one it replaced,
+  // which is kept for a single crossfaded frame after a swap, then until it
+  // can be handed back through _retiredEngine
+  std::shared_ptr<RAVE> _workerEngine;
+  std::shared_ptr<RAVE> _fadingEngine;
+  std::shared_ptr<RAVE> _retiringEngine;
+  int _workerEpoch = -1;
+  // filled by the worker when _hasRetiredEngine is false, emptied by
+  // releaseRetiredEngine
+  atomic_shared_ptr<RAVE> _retiredEngine;
+  std::atomic<bool> _hasRetiredEngine{false};
+  std::mutex _retiredEngineLock;
+  // frames given up by the audio thread because the worker was running late,
+  // and blocks played with part of their output missing
+  std::atomic<int> _missedFrames{0};
+  std::atomic<int> _lateBlocks{0};
 
   bool _editorReady;
 
@@ -143,6 +280,8 @@ private:
   std::atomic<float> *_latencyMode;
   std::atomic<float> *_usePrior;
   std::atomic<float> *_priorTemperature;
+  std::atomic<float> *_batchedInference;
+  std::atomic<float> *_latencyAuto;
 
   std::array<std::atomic<float> *, AVAILABLE_DIMS> *_latentScale;
   std::array<std::atomic<float> *, AVAILABLE_DIMS> *_latentBias;
@@ -162,5 +301,31 @@ private:
   juce::dsp::Limiter<float> _limiterEffect;
   juce::dsp::DryWetMixer<float> _dryWetMixerEffect;
 
+  void prepareResampling(double modelSampleRate);
+  void resetPipeline();
+  // audio thread, follows isNonRealtime()
+  void updateOfflineMode();
+  int getModelBlockSize();
+  int getModelBlockSize(double modelSampleRate);
+  // latency_mode, or the nearest mode engine supports
+  int getLatencyModeFor(RAVE &engine);
+  void readWet(float *left, float *right, int n);
+
+  bool canBatch(RAVE &engine);
+  int getOfflineBatch(int frameSize);
+  // tells the frames of the instances apart in traces
+  juce::uint64 getTraceId(int64_t frameStart) const {
+    return (juce::uint64)frameStart * 0x9E3779B97F4A7C15ull ^
+           (juce::uint64)(uintptr_t)this;
+  }
+  int getPipelineLatency(int frameSize);
+  int getReportedLatency(int frameSize);
+  void applyLatencyChange(int nSamples);
+  void recordLoad(double load);
+  // runs the latency governor when latency_auto is on
+  void timerCallback() override;
+  void performFrame(RAVE &engine, RaveWorkspace &ws, int input_size,
+                    at::Tensor &outL, at::Tensor &outR, int batch = 1);
+
   JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(RaveAP)
 };
@@ -5,152 +5,391 @@
 
 #define DEBUG_PERFORM 0
 
-void RaveAP::modelPerform() {
-  if (_rave.get() && !_isMuted.load()) {
-    c10::InferenceMode guard(true);
-    // encode
-    int input_size = static_cast<int>(pow(2, *_latencyMode));
+// Copies one decoded channel straight into the ring's storage. Model outputs
+// are usually contiguous floats and this is a plain memcpy; anything else
+// (e.g. after the Windows transpose) goes through a stride-aware tensor copy.
+// Missing samples are zeroed.
+static void writeToRing(ring_buffer<float> &ring, const at::Tensor &channel,
+                        int n) {
+  float *dst = ring.write_span(n);
+  jassert(dst != nullptr); // room is checked by modelPerform
+  const int64_t available = std::min<int64_t>(channel.size(0), n);
+  if (channel.scalar_type() == at::kFloat && channel.is_contiguous()) {
+    std::memcpy(dst, channel.data_ptr<float>(), available * sizeof(float));
+  } else {
+    torch::from_blob(dst, {available}).copy_(channel.narrow(0, 0, available));
+  }
+  std::fill(dst + available, dst + n, 0.f);
+  ring.commit_write(n);
+}
+
+// Crossfades a frame of the previous engine (from, undefined for silence) into
+// the same frame from the new one, over the whole frame. Only happens once
+// per model swap, so it can allocate.
+static void crossfade(at::Tensor &to, const at::Tensor &from, int n) {
+  int64_t length = std::min<int64_t>(to.size(0), n);
+  if (from.defined())
+    length = std::min(length, from.size(0));
+  at::Tensor ramp = torch::linspace(0.f, 1.f, length);
+  if (from.defined())
+    to = at::lerp(from.narrow(0, 0, length), to.narrow(0, 0, length), ramp);
+  else
+    to = to.narrow(0, 0, length) * ramp;
+}
+
+// Whether engine can perform consecutive frames as one batch: streaming
+// models carry state from one frame to the next, and the prior and stereo
+// width paths work on a single frame.
+bool RaveAP::canBatch(RAVE &engine) {
+  return !engine.isStreaming() && !engine.isStereo() &&
+         !(engine.hasPrior() && *_usePrior);
+}
+
+void RaveAP::modelPerform(int maxBatch) {
+  // Runs on the inference worker (or inline when rendering offline), which
+  // performs the queued frames in order and appends their output to
+  // _outBuffer: output sample i always corresponds to input sample i.
+
+  // torch's thread count belongs to the calling thread, which is given this
+  // instance's share of the cores whenever the share changes
+  ThreadBudget::getInstance().rebalance();
+  thread_local int appliedThreads = 0;
+  const int threads = _threadShare.getShare();
+  if (threads > 0 && threads != appliedThreads &&
+      TorchRuntime::isInitialised()) {
+    at::set_num_threads(threads);
+    appliedThreads = threads;
+  }
+
+  while (FrameTicket *ticket = _frameQueue.front()) {
+    // pick up the engine published by the last model swap, if any, once
+    // the previous one could be handed back
+    const int epoch = _engineEpoch.load(std::memory_order_acquire);
+    if (epoch != _workerEpoch && _retiringEngine == nullptr) {
+      _fadingEngine = std::move(_workerEngine);
+      _workerEngine = getEngine();
+      _workerEpoch = epoch;
+    }
+
+    // consecutive frames of the same size are contiguous in the input ring,
+    // and go through the model together when it allows it
+    const int frame_size = ticket->size;
+    if (_workerEngine != nullptr)
+      _threadShare.setMaxThreads(_workerEngine->getTunedThreads(frame_size));
+    int batch = 1;
+    if (maxBatch > 1 && _workerEngine != nullptr && canBatch(*_workerEngine)) {
+      while (batch < maxBatch && (batch + 1) * frame_size <= BUFFER_LENGTH) {
+        FrameTicket *next = _frameQueue.at(batch);
+        if (next == nullptr || next->size != frame_size)
+          break;
+        batch++;
+      }
+    }
+    const size_t input_size = (size_t)frame_size * batch;
+    if (_outBuffer[0].space() < input_size ||
+        _outBuffer[1].space() < input_size)
+      return;
+
+    int owned = 0;
+    for (int i = 0; i < batch; i++) {
+      int expected = FrameTicket::queued;
+      owned += _frameQueue.at(i)->state.compare_exchange_strong(
+          expected, FrameTicket::computing, std::memory_order_acq_rel);
+    }
+    RaveWorkspace *ws =
+        _workerEngine ? _workerEngine->getWorkspace(frame_size) : nullptr;
+    bool performed = false;
+    if (owned == batch && ws != nullptr && !_isMuted.load()) {
+      try {
+        at::Tensor outL, outR;
+        _performanceMeter.beginFrame();
+        performFrame(*_workerEngine, *ws, frame_size, outL, outR, batch);
+        // nothing to crossfade with a model running at another rate, the
+        // pipeline was restarted for the new one
+        if (_fadingEngine != nullptr && _fadingEngine->getSamplingRate() ==
+                                            _workerEngine->getSamplingRate()) {
+          // the previous engine performs this frame too, and fades out
+          at::Tensor fadingL, fadingR;
+          RaveWorkspace *fadingWs = _fadingEngine->getWorkspace(frame_size);
+          if (fadingWs != nullptr && (batch == 1 || canBatch(*_fadingEngine)))
+            performFrame(*_fadingEngine, *fadingWs, frame_size, fadingL,
+                         fadingR, batch);
+          crossfade(outL, fadingL, input_size);
+          crossfade(outR, fadingR, input_size);
+        }
+        // right channel first as the audio thread looks at the left one to
+        // know how many samples are available
+        writeToRing(_outBuffer[1], outR, input_size);
+        writeToRing(_outBuffer[0], outL, input_size);
+        _performanceMeter.lap(PerformanceMeter::output);
+        const double load =
+            _performanceMeter.endFrame(input_size / _modelSampleRate);
+        performed = true;
+        if (!_offline.load())
+          recordLoad(load);
+      } catch (const c10::Error &e) {
+        std::cerr << e.what();
+      }
+      if (_smoothedFadeInOut.getCurrentValue() < EPSILON) {
+        _isMuted.store(true);
+      }
+    }
+    // a muted instance no longer decodes, the others should not wait for it
+    if (_isMuted.load() && _workerEngine != nullptr)
+      _workerEngine->leaveBatch();
+    // the previous engine is handed back rather than freed here, see
+    // releaseRetiredEngine
+    if (_fadingEngine != nullptr)
+      _retiringEngine = std::move(_fadingEngine);
+    if (_retiringEngine != nullptr && !_hasRetiredEngine.load()) {
+      _retiredEngine.exchange(std::move(_retiringEngine));
+      _hasRetiredEngine.store(true);
+    }
+    // explicit fallback for abandoned, muted or failed frames: silence
+    if (!performed) {
+      _outBuffer[1].put_zeros(input_size);
+      _outBuffer[0].put_zeros(input_size);
+    }
+    _missedFrames += batch - owned;
+    for (int i = 0; i < batch; i++) {
+      FrameTicket *done = _frameQueue.at(i);
+      Tracer::getInstance().asyncEnd("frame", "frame",
+                                     getTraceId(done->start));
+      done->state.store(FrameTicket::done, std::memory_order_release);
+    }
+    _inBuffer[0].discard(input_size);
+    _frameQueue.pop(batch);
+  }
+}
 
-    at::Tensor latent_traj;
-    at::Tensor latent_traj_mean;
+void RaveAP::performFrame(RAVE &engine, RaveWorkspace &ws, int input_size,
+                          at::Tensor &outL, at::Tensor &outR, int batch) {
+  RAVE_TRACE("performFrame");
+  c10::InferenceMode guard(true);
+  engine.setBatchedDecode(_batchedInference->load() > 0.5f);
+
+  at::Tensor latent_traj;
+  at::Tensor latent_traj_mean;
 
 #if DEBUG_PERFORM
-    std::cout << "exp: " << *_latencyMode << " value: " << input_size << '\n';
-    std::cout << "has prior : " << _rave->hasPrior()
-              << "; use prior : " << *_usePrior << std::endl;
-    std::cout << "temperature : " << *_priorTemperature << std::endl;
+  std::cout << "exp: " << *_latencyMode << " value: " << input_size << '\n';
+  std::cout << "has prior : " << engine.hasPrior()
+            << "; use prior : " << *_usePrior << std::endl;
+  std::cout << "temperature : " << *_priorTemperature << std::endl;
 #endif
 
-    if (_rave->hasPrior() && *_usePrior) {
-      auto n_trajs = pow(2, *_latencyMode) / _rave->getModelRatio();
-      latent_traj = _rave->sample_prior((int)n_trajs, *_priorTemperature);
-      latent_traj_mean = latent_traj;
-    } else {
-      int64_t sizes = {input_size};
-      at::Tensor frame = torch::from_blob(_inModel[0].get(), sizes);
-      frame = torch::reshape(frame, {1, 1, input_size});
+  if (engine.hasPrior() && *_usePrior) {
+    latent_traj = engine.sample_prior(ws, *_priorTemperature);
+    latent_traj_mean = latent_traj;
+  } else {
+    // view straight over the input ring, it is discarded once performed
+    float *frame_data =
+        const_cast<float *>(_inBuffer[0].read_span(input_size * batch));
+    at::Tensor frame = torch::from_blob(frame_data, {batch, 1, input_size});
 
 #if DEBUG_PERFORM
-      std::cout << "Current input size : " << frame.sizes() << std::endl;
+    std::cout << "Current input size : " << frame.sizes() << std::endl;
 #endif DEBUG_PERFORM
 
-      if (_rave->hasMethod("encode_amortized")) {
-        std::vector<torch::Tensor> latent_probs = _rave->encode_amortized(frame);
-        latent_traj_mean = latent_probs[0];
-        at::Tensor latent_traj_std = latent_probs[1];
-
-  #if DEBUG_PERFORM
-        std::cout << "mean shape" << latent_traj_mean.sizes() << std::endl;
-        std::cout << "std shape" << latent_traj_std.sizes() << std::endl;
-  #endif
-
-        latent_traj = latent_traj_mean +
-                      latent_traj_std * torch::randn_like(latent_traj_mean);
-      } else {
-        latent_traj = _rave->encode(frame);
-        latent_traj_mean = latent_traj;
-      }
-    }
+    if (engine.hasMethod("encode_amortized")) {
+      std::vector<torch::Tensor> latent_probs = engine.encode_amortized(frame);
+      latent_traj_mean = latent_probs[0];
+      at::Tensor latent_traj_std = latent_probs[1];
 
 #if DEBUG_PERFORM
-    std::cout << "latent traj shape" << latent_traj.sizes() << std::endl;
+      std::cout << "mean shape" << latent_traj_mean.sizes() << std::endl;
+      std::cout << "std shape" << latent_traj_std.sizes() << std::endl;
 #endif
 
-    // Latent modifications
-    // apply scale and bias
-    int64_t n_dimensions =
-        std::min((int)latent_traj.size(1), (int)AVAILABLE_DIMS);
-    for (int i = 0; i < n_dimensions; i++) {
-      // The assert and casting here is needed as I got a:
-      // warning: conversion to ‘std::array<std::atomic<float>*,
-      // 8>::size_type’ {aka ‘long unsigned int’} from ‘int’ may change the
-      // sign of the result [-Wsign-conversion]
-      // Whatever AVAILABLE_DIMS type I defined
-      assert(i >= 0);
-      auto i2 = (long unsigned int)i;
-      float scale = _latentScale->at(i2)->load();
-      float bias = _latentBias->at(i2)->load();
-      latent_traj.index_put_({0, i},
-                             (latent_traj.index({0, i}) * scale + bias));
-      latent_traj_mean.index_put_(
-          {0, i}, (latent_traj_mean.index({0, i}) * scale + bias));
+      // trajectory = mean + std * noise, written into the workspace
+      at::Tensor &noise = RaveWorkspace::fit(ws.noise, latent_traj_mean.sizes());
+      latent_traj = RaveWorkspace::fit(ws.trajectory, latent_traj_mean.sizes());
+      noise.normal_();
+      at::addcmul_out(latent_traj, latent_traj_mean, latent_traj_std, noise);
+    } else {
+      latent_traj = engine.encode(frame);
+      latent_traj_mean = latent_traj;
     }
-    _rave->writeLatentBuffer(latent_traj_mean);
+  }
+  _performanceMeter.lap(PerformanceMeter::encode);
 
 #if DEBUG_PERFORM
-    std::cout << "scale & bias applied" << std::endl;
+  std::cout << "latent traj shape" << latent_traj.sizes() << std::endl;
 #endif
 
-    // adding latent jitter on meaningful dimensions
-    float jitter_amount = _latentJitterValue->load();
-    latent_traj = latent_traj + jitter_amount * torch::randn_like(latent_traj);
+  // Latent modifications
+  // apply scale and bias, in place on the first dimensions
+  int64_t n_dimensions =
+      std::min((int)latent_traj.size(1), (int)AVAILABLE_DIMS);
+  at::Tensor &scale = RaveWorkspace::fit(ws.scale, {1, n_dimensions, 1});
+  at::Tensor &bias = RaveWorkspace::fit(ws.bias, {1, n_dimensions, 1});
+  float *scalePtr = scale.data_ptr<float>();
+  float *biasPtr = bias.data_ptr<float>();
+  for (size_t i = 0; i < (size_t)n_dimensions; i++) {
+    scalePtr[i] = _latentScale->at(i)->load();
+    biasPtr[i] = _latentBias->at(i)->load();
+  }
+  latent_traj.narrow(1, 0, n_dimensions).mul_(scale).add_(bias);
+  if (!latent_traj_mean.is_same(latent_traj))
+    latent_traj_mean.narrow(1, 0, n_dimensions).mul_(scale).add_(bias);
+  engine.writeLatentBuffer(latent_traj_mean.narrow(0, batch - 1, 1));
 
 #if DEBUG_PERFORM
-    std::cout << "jitter applied" << std::endl;
+  std::cout << "scale & bias applied" << std::endl;
 #endif
 
-    // filling missing dimensions with width parameter
-    int missing_dims = _rave->getFullLatentDimensions() - latent_traj.size(1);
-
-    if (_rave->isStereo() && missing_dims > 0) {
-      torch::Tensor latent_trajL = latent_traj,
-                    latent_trajR = latent_traj.clone();
-      int missing_dims = _rave->getFullLatentDimensions() - latent_trajL.size(1);
-      float width = _widthValue->load() / 100.f;
-      at::Tensor latent_noiseL =
-          torch::randn({1, missing_dims, latent_trajL.size(2)});
-      at::Tensor latent_noiseR =
-          (1 - width) * latent_noiseL +
-          width * torch::randn({1, missing_dims, latent_trajL.size(2)});
-
-  #if DEBUG_PERFORM
-      std::cout << "after width : " << latent_noiseL.sizes() << ";"
-                << latent_trajL.sizes() << std::endl;
-  #endif
-
-      latent_trajL = torch::cat({latent_trajL, latent_noiseL}, 1);
-      latent_trajR = torch::cat({latent_trajR, latent_noiseR}, 1);
-
-  #if DEBUG_PERFORM
-      std::cout << "latent processed" << std::endl;
-  #endif
-
-      latent_traj = torch::cat({latent_trajL, latent_trajR}, 0);
-    }
+  // adding latent jitter on meaningful dimensions
+  float jitter_amount = _latentJitterValue->load();
+  if (jitter_amount > 0.f) {
+    at::Tensor &noise = RaveWorkspace::fit(ws.noise, latent_traj.sizes());
+    latent_traj.add_(noise.normal_(), jitter_amount);
+  }
 
-    // Decode
-    at::Tensor out = _rave->decode(latent_traj);
-    // On windows, I don't get why, but the two first dims are swapped (compared
-    // to macOS / UNIX) with the same torch version
-    if (out.sizes()[0] == 2) {
-      out = out.transpose(0, 1);
-    }
+#if DEBUG_PERFORM
+  std::cout << "jitter applied" << std::endl;
+#endif
 
-    const int outIndexR = (out.sizes()[1] > 1 ? 1 : 0);
-    at::Tensor outL = out.index({0, 0, at::indexing::Slice()});
-    at::Tensor outR = out.index({0, outIndexR, at::indexing::Slice()});
+  // filling missing dimensions with width parameter
+  int missing_dims = engine.getFullLatentDimensions() - latent_traj.size(1);
+
+  if (engine.isStereo() && missing_dims > 0) {
+    const int64_t latent_dims = latent_traj.size(1);
+    at::Tensor &stereo_latent = RaveWorkspace::fit(
+        ws.stereoLatent,
+        {2, engine.getFullLatentDimensions(), latent_traj.size(2)});
+    float width = _widthValue->load() / 100.f;
+    stereo_latent.narrow(1, 0, latent_dims)
+        .copy_(latent_traj.expand({2, latent_dims, latent_traj.size(2)}));
+    at::Tensor latent_noiseL =
+        stereo_latent.select(0, 0).narrow(0, latent_dims, missing_dims);
+    at::Tensor latent_noiseR =
+        stereo_latent.select(0, 1).narrow(0, latent_dims, missing_dims);
+    // noiseR = (1 - width) * noiseL + width * N(0, 1)
+    latent_noiseL.normal_();
+    latent_noiseR.normal_().mul_(width).add_(latent_noiseL, 1 - width);
 
 #if DEBUG_PERFORM
-    std::cout << "latent decoded" << std::endl;
+    std::cout << "after width : " << stereo_latent.sizes() << std::endl;
 #endif
 
-    float *outputDataPtrL, *outputDataPtrR;
-    outputDataPtrL = outL.data_ptr<float>();
-    outputDataPtrR = outR.data_ptr<float>();
+    latent_traj = stereo_latent;
+  }
+  _performanceMeter.lap(PerformanceMeter::latent);
+
+  // Decode
+  at::Tensor out = engine.decode(latent_traj);
+  // On windows, I don't get why, but the two first dims are swapped (compared
+  // to macOS / UNIX) with the same torch version
+  if (batch == 1 && out.sizes()[0] == 2) {
+    out = out.transpose(0, 1);
+  }
 
-    // Write in buffers
-    assert(input_size >= 0);
-    for (size_t i = 0; i < (size_t)input_size; i++) {
-      _outModel[0][i] = outputDataPtrL[i];
-      _outModel[1][i] = outputDataPtrR[i];
-    }
-    if (_smoothedFadeInOut.getCurrentValue() < EPSILON) {
-      _isMuted.store(true);
-    }
+  // {batch, channels, frame}: consecutive frames end to end per channel
+  const int outIndexR = (out.sizes()[1] > 1 ? 1 : 0);
+  outL = out.select(1, 0).reshape({-1});
+  outR = out.select(1, outIndexR).reshape({-1});
+  _performanceMeter.lap(PerformanceMeter::decode);
+
+#if DEBUG_PERFORM
+  std::cout << "latent decoded" << std::endl;
+#endif
+}
+
+int RaveAP::getFrameSize() {
+  // streaming models follow the host block size, others the latency mode
+  const int streamingFrameSize = _streamingFrameSize.load();
+  if (streamingFrameSize > 0)
+    return streamingFrameSize;
+  return 1 << _frameExponent.load(std::memory_order_relaxed);
+}
+
+int RaveAP::getTargetFrameSize() {
+  const int streamingFrameSize = _streamingFrameSize.load();
+  if (streamingFrameSize > 0)
+    return streamingFrameSize;
+  return static_cast<int>(pow(2, *_latencyMode));
+}
+
+int RaveAP::getFrameSizeFor(RAVE &engine) {
+  if (engine.isStreaming() && _hostBlockSize > 0)
+    return engine.getStreamingFrameSize(
+        getModelBlockSize(engine.getSamplingRate()));
+  return 1 << getLatencyModeFor(engine);
+}
+
+int RaveAP::getOfflineBatch(int frameSize) {
+  if (!_offline.load())
+    return 0;
+  if (!_offlineBatching.load())
+    return 1;
+  return jlimit(1, 8, BUFFER_LENGTH / frameSize);
+}
+
+int RaveAP::getPipelineLatency() { return getPipelineLatency(getFrameSize()); }
+
+int RaveAP::getPipelineLatency(int frameSize) {
+  // one frame to fill the input, one more for the worker to compute it.
+  // Offline, frames are gathered into batches before being performed.
+  const int batch = getOfflineBatch(frameSize);
+  return (batch > 1 ? batch + 1 : 2) * frameSize;
+}
+
+int RaveAP::getReportedLatency() {
+  return getReportedLatency(getTargetFrameSize());
+}
+
+int RaveAP::getReportedLatency(int frameSize) {
+  // pipeline latency is at the model rate, the resamplers add their own
+  double latency = getPipelineLatency(frameSize);
+  if (_inputResampler.isActive())
+    latency = latency * _sampleRate / _modelSampleRate +
+              _inputResampler.getInputDelay() +
+              _outputResamplers[0].getOutputDelay();
+  return juce::jmin((int)std::lround(latency), MAX_WET_LATENCY);
+}
+
+// Reads n samples of model output at the model rate. Output sample i plays
+// the model output of input sample i - latency. Whatever comes too late is
+// dropped and replaced by silence, so that the latency stays the same
+// whatever the inference time.
+void RaveAP::readWet(float *left, float *right, int n) {
+  const int64_t target =
+      _outputPlayed - getPipelineLatency() - _inputDropped;
+  if (!_offline.load())
+    _frameQueue.abandonLate(target + n);
+  if (_outputConsumed < target) {
+    const size_t stale =
+        _outBuffer[0].discard((size_t)(target - _outputConsumed));
+    _outBuffer[1].discard(stale);
+    _outputConsumed += stale;
   }
+  const int silent = (int)jlimit<int64_t>(0, n, _outputConsumed - target);
+  const size_t toRead =
+      std::min((size_t)(n - silent), _outBuffer[0].len());
+  std::fill(left, left + n, 0.f);
+  std::fill(right, right + n, 0.f);
+  _outBuffer[0].get(left + silent, toRead);
+  _outBuffer[1].get(right + silent, toRead);
+  _outputConsumed += toRead;
+  _outputPlayed += n;
+  if (silent < n && toRead < (size_t)(n - silent))
+    _lateBlocks++;
 }
 
-void modelPerform_callback(RaveAP *ap) { ap->modelPerform(); }
+// Hosts may switch to offline rendering and back without preparing again,
+// e.g. through the offline render property of AU: the pipeline starts over
+// in the new mode, so that a bounce never drops a frame.
+void RaveAP::updateOfflineMode() {
+  const bool offline = isNonRealtime();
+  if (offline == _offline.load())
+    return;
+  rt_check::ScopedRealtimeBypass modeChange;
+  _offline.store(offline);
+  resetPipeline();
+  _dryWetMixerEffect.reset();
+  setLatencySamples(getReportedLatency());
+  _wetLatencyChanged.store(true);
+}
 
 void RaveAP::processBlock(juce::AudioBuffer<float> &buffer,
                           juce::MidiBuffer & /*midiMessages*/) {
@@ -158,7 +397,16 @@ void RaveAP::processBlock(juce::AudioBuffer<float> &buffer,
 # if DEBUG_PERFORM
   std::cout << "processing block..." << std::endl;
 # endif
+  rt_check::ScopedRealtimeSection realtimeSection;
   juce::ScopedNoDenormals noDenormals;
+  updateOfflineMode();
+  auto &tracer = Tracer::getInstance();
+  if (tracer.isEnabled())
+    tracer.setThreadName(_offline.load() ? "offline render" : "audio");
+  RAVE_TRACE("processBlock");
+  // instances stop being counted in the thread budget when the host no longer
+  // calls this, e.g. when bypassed
+  _threadShare.markActive();
   const int nSamples = buffer.getNumSamples();
   const int nChannels = buffer.getNumChannels();
 
@@ -166,7 +414,11 @@ void RaveAP::processBlock(juce::AudioBuffer<float> &buffer,
   // mute if pause
   // TODO : this makes output muted in max, add check box to make this an option
   AudioPlayHead *playHead = this->getPlayHead();
-  if (playHead != nullptr) {
+  if (_offline.load()) {
+    // a bounce always plays
+    if (_isMuted.load())
+      unmute();
+  } else if (playHead != nullptr) {
     // std::cout << "has playhead! " << std::endl;
     AudioPlayHead::CurrentPositionInfo info;
     bool hasDawInformation = playHead->getCurrentPosition(info);
@@ -178,8 +430,6 @@ void RaveAP::processBlock(juce::AudioBuffer<float> &buffer,
         unmute();
       } else if (!isPlaying && !_isMuted.load()) {
         mute();
-        _inBuffer.get()->reset();
-        _outBuffer.get()->reset();
       }
     }
   }
@@ -213,46 +463,84 @@ void RaveAP::processBlock(juce::AudioBuffer<float> &buffer,
     channelR = buffer.getWritePointer(1);
   }
 
-  juce::String channelMode =
-      channel_modes[static_cast<int>(_channelMode->load()) - 1];
-  if (channelMode == "L") {
-    _inBuffer[0].put(channelL, nSamples);
-  } else if (channelMode == "R") {
-    _inBuffer[0].put(channelR, nSamples);
-  } else if (channelMode == "L + R") {
+  const float *modelInput = channelL;
+  switch (static_cast<ChannelMode>(static_cast<int>(_channelMode->load()))) {
+  case ChannelMode::left:
+    break;
+  case ChannelMode::right:
+    modelInput = channelR;
+    break;
+  case ChannelMode::both:
     FloatVectorOperations::add(channelL, channelR, nSamples);
     FloatVectorOperations::multiply(channelL, 0.5f, nSamples);
-    _inBuffer[0].put(channelL, nSamples);
+    break;
   }
+  if (_inputResampler.isActive()) {
+    // to the model rate, by blocks fitting the scratch buffer
+    float *resampled = _resampledInput.getWritePointer(0);
+    const int chunk = jmax(1, _hostBlockSize);
+    for (int start = 0; start < nSamples; start += chunk) {
+      const int n = jmin(chunk, nSamples - start);
+      const int m = _inputResampler.process(modelInput + start, n, resampled,
+                                            _resampledInput.getNumSamples());
+      const size_t pushed = _inBuffer[0].put(resampled, m);
+      _inputPushed += pushed;
+      _inputDropped += m - (int64_t)pushed;
+    }
+  } else {
+    const size_t pushed = _inBuffer[0].put(modelInput, nSamples);
+    _inputPushed += pushed;
+    _inputDropped += nSamples - (int64_t)pushed;
+  }
+
+  applyLatencyChange(nSamples);
 
-  // create processing thread
-  int currentRefreshRate = pow(2, *_latencyMode);
-  if (_inBuffer[0].len() >= currentRefreshRate) {
+  // queue every completed frame and wake the inference worker up
+  const int currentRefreshRate = getFrameSize();
+  bool queued = false;
+  while (_inputPushed - _frameStart >= currentRefreshRate &&
+         _frameQueue.push(_frameStart, currentRefreshRate)) {
 #if DEBUG_PERFORM
       std::cout << "buffer full..." << std::endl;
 #endif    
-    if (_computeThread) {
-
-#if DEBUG_PERFORM
-      std::cout << "joining..." << std::endl;
-#endif
-
-      _computeThread->join();
+    tracer.asyncBegin("frame", "frame", getTraceId(_frameStart));
+    _frameStart += currentRefreshRate;
+    queued = true;
+  }
+  if (_offline.load()) {
+    // no deadline offline: every frame is performed here, by batches
+    const int batch = getOfflineBatch(currentRefreshRate);
+    if (queued && _frameQueue.size() >= (size_t)batch) {
+      rt_check::ScopedRealtimeBypass offlineRender;
+      modelPerform(batch);
     }
-    _inBuffer[0].get(_inModel[0].get(), currentRefreshRate);
-    _outBuffer[0].put(_outModel[0].get(), currentRefreshRate);
-    _outBuffer[1].put(_outModel[1].get(), currentRefreshRate);
-    _computeThread = std::make_unique<std::thread>(modelPerform_callback, this);
+  } else if (queued) {
+    _inferenceWorker->submit();
   }
 
-  AudioBuffer<float> out_buffer(2, nSamples);
+  // only reallocates if the host goes over the block size given to
+  // prepareToPlay
+  _wetBuffer.setSize(2, nSamples, false, false, true);
+  AudioBuffer<float> &out_buffer = _wetBuffer;
   juce::dsp::AudioBlock<float> out_ab(out_buffer);
   juce::dsp::ProcessContextReplacing<float> out_context(out_ab);
-  if (_outBuffer[0].len() >= nSamples) {
-    _outBuffer[0].get(out_buffer.getWritePointer(0), nSamples);
-    _outBuffer[1].get(out_buffer.getWritePointer(1), nSamples);
-  } else {
+  if (_outputResamplers[0].isActive()) {
+    // pull as many model rate samples as each host chunk needs
     out_buffer.clear();
+    const int chunk = jmax(1, _hostBlockSize);
+    for (int start = 0; start < nSamples; start += chunk) {
+      const int n = jmin(chunk, nSamples - start);
+      const int m = jmin(_outputResamplers[0].inputFor(n),
+                         _modelOutput.getNumSamples());
+      readWet(_modelOutput.getWritePointer(0), _modelOutput.getWritePointer(1),
+              m);
+      for (int c = 0; c < 2; c++)
+        _outputResamplers[c].process(_modelOutput.getReadPointer(c), m,
+                                     out_buffer.getWritePointer(c) + start, n);
+    }
+  } else {
+    readWet(out_buffer.getWritePointer(0), out_buffer.getWritePointer(1),
+            nSamples);
   }
 
 #if DEBUG_PERFORM
@@ -268,6 +556,8 @@ void RaveAP::processBlock(juce::AudioBuffer<float> &buffer,
   buffer.copyFrom(0, 0, out_buffer, 0, 0, nSamples);
   if (nChannels == 2)
     buffer.copyFrom(1, 0, out_buffer, 1, 0, nSamples);
+  // dry and wet both jump when the latency changes, hide it
+  _smoothedReconfigure.applyGain(buffer, nSamples);
 
 #if DEBUG_PERFORM
   std::cout << "sortie : " << buffer.getMagnitude(0, nSamples) << std::endl;
@@ -275,7 +565,6 @@ void RaveAP::processBlock(juce::AudioBuffer<float> &buffer,
 }
 
 void RaveAP::parameterChanged(const String &parameterID, float newValue) {
-  std::cout << "hello here?" << std::endl;
   if (parameterID == rave_parameters::input_gain) {
     _inputGainEffect.setGainDecibels(newValue);
   } else if (parameterID == rave_parameters::input_ratio) {
@@ -287,28 +576,150 @@ void RaveAP::parameterChanged(const String &parameterID, float newValue) {
   } else if (parameterID == rave_parameters::output_drywet) {
     _dryWetMixerEffect.setWetMixProportion(newValue / 100.f);
   } else if (parameterID == rave_parameters::latency_mode) {
-    auto latency_samples = pow(2, *_latencyMode);
+    // the audio thread moves to the new frame size, and delays the dry signal
+    // accordingly, see applyLatencyChange
+    auto latency_samples = getReportedLatency();
     std::cout << "[ ] - latency has changed to " << latency_samples
               << std::endl;
     setLatencySamples(latency_samples);
-    _dryWetMixerEffect.setWetLatency(latency_samples);
   }
 }
 
-void RaveAP::updateBufferSizes() {
-  auto validBufferSizes = _rave->getValidBufferSizes();
+// Moves to the frame size of latency_mode without a click: the output fades
+// out, the frame size changes, and the output fades back in once the frames
+// of the new size come out, i.e. after the silence of a latency increase.
+void RaveAP::applyLatencyChange(int nSamples) {
+  if (_wetLatencyChanged.exchange(false))
+    _dryWetMixerEffect.setWetLatency(getReportedLatency(getFrameSize()));
+  const int target = (int)_latencyMode->load();
+  if (target != _frameExponent.load(std::memory_order_relaxed)) {
+    // offline, muted or with a streaming model, there is nothing to hide
+    if (_offline.load() || isStreaming() || _isMuted.load() ||
+        _smoothedReconfigure.getCurrentValue() < EPSILON) {
+      const int previous = getReportedLatency(getFrameSize());
+      _frameExponent.store(target, std::memory_order_relaxed);
+      const int latency = getReportedLatency(getFrameSize());
+      _dryWetMixerEffect.setWetLatency(latency);
+      _reconfigureHold = std::max(0, latency - previous);
+    } else {
+      _smoothedReconfigure.setTargetValue(0.f);
+    }
+  } else if (_reconfigureHold > 0) {
+    _reconfigureHold -= nSamples;
+  } else {
+    _smoothedReconfigure.setTargetValue(1.f);
+  }
+}
+
+void RaveAP::recordLoad(double load) {
+  float peak = _peakLoad.load(std::memory_order_relaxed);
+  while (load > peak &&
+         !_peakLoad.compare_exchange_weak(peak, (float)load,
+                                          std::memory_order_relaxed)) {
+  }
+}
+
+void RaveAP::timerCallback() {
+  // in case the loader gave up waiting for the worker
+  releaseRetiredEngine();
+  const float load = _peakLoad.exchange(0.f);
+  const int missedFrames = _missedFrames.load();
+  const int missed = missedFrames - _governorMissedFrames;
+  _governorMissedFrames = missedFrames;
+
+  auto engine = getEngine();
+  const int epoch = _engineEpoch.load();
+  if (_latencyAuto->load() < 0.5f || _offline.load() || engine == nullptr ||
+      !engine->isLoaded() || engine->isStreaming() || epoch != _governorEpoch ||
+      getFrameSize() != getTargetFrameSize()) {
+    // off, or the model or frame size just changed: start over
+    _governorEpoch = epoch;
+    _latencyGovernor.reset();
+    return;
+  }
+
+  LatencyGovernor::Measure measure;
+  measure.frameSize = getFrameSize();
+  measure.sampleRate = _modelSampleRate;
+  measure.peakLoad = load;
+  measure.missedFrames = missed;
+  const int frameSize = _latencyGovernor.update(
+      measure, engine->getWarmUpTimings(), engine->getValidBufferSizes());
+  if (frameSize == measure.frameSize)
+    return;
+  std::cout << "[ ] - auto latency: " << measure.frameSize << " -> "
+            << frameSize << " samples, peak load " << load << std::endl;
+  auto *parameter = _avts.getParameter(rave_parameters::latency_mode);
+  parameter->setValueNotifyingHost(
+      parameter->convertTo0to1((float)std::log2(frameSize)));
+}
+
+int RaveAP::getLatencyModeFor(RAVE &engine) {
+  auto validBufferSizes = engine.getValidBufferSizes();
   float a = validBufferSizes.getStart();
   float b = validBufferSizes.getEnd();
+  if (pow(2, *_latencyMode) < a)
+    return static_cast<int>(log2(a));
+  if (pow(2, *_latencyMode) > b)
+    return static_cast<int>(log2(b));
+  return (int)_latencyMode->load();
+}
 
-  if (*_latencyMode < a) {
-    std::cout << "too low; setting rate to : " << static_cast<int>(log2(a))
-              << std::endl;
-    *_latencyMode = static_cast<int>(log2(a));
-  } else if (*_latencyMode > b) {
-    std::cout << "too high; setting rate to : " << static_cast<int>(log2(b))
-              << std::endl;
-    *_latencyMode = static_cast<int>(log2(b));
+void RaveAP::updateBufferSizes(RAVE &engine) {
+  // the audio thread fades over to it, see applyLatencyChange
+  const int latencyMode = getLatencyModeFor(engine);
+  if (latencyMode != (int)_latencyMode->load()) {
+    std::cout << "[ ] - latency mode out of the model's range, setting it to "
+              << latencyMode << std::endl;
+    *_latencyMode = (float)latencyMode;
   }
+  updateStreamingMode(&engine);
+}
+
+void RaveAP::updateStreamingMode(RAVE *engine) {
+  const bool streaming = engine != nullptr && engine->isStreaming();
+  if (streaming && _hostBlockSize > 0) {
+    _streamingFrameSize.store(
+        engine->getStreamingFrameSize(getModelBlockSize()));
+    std::cout << "[ ] - streaming model, frame size: "
+              << _streamingFrameSize.load() << std::endl;
+  } else {
+    _streamingFrameSize.store(0);
+  }
+  _offlineBatching.store(!streaming &&
+                         (engine == nullptr || !engine->isStereo()));
+  setLatencySamples(getReportedLatency());
+  // the dry signal is delayed by the audio thread, see applyLatencyChange
+  _wetLatencyChanged.store(true);
+}
+
+std::shared_ptr<RAVE> RaveAP::swapEngine(std::shared_ptr<RAVE> engine) {
+  RAVE &next = *engine;
+  std::shared_ptr<RAVE> previous = _rave.exchange(std::move(engine));
+  _engineEpoch.fetch_add(1, std::memory_order_release);
+  // the sizes of the previous engine held until now
+  updateBufferSizes(next);
+  // the worker only applies torch's thread settings once the runtime is up
+  applyThreadSettings();
+  _engineBroadcaster.sendChangeMessage();
+  return previous;
+}
+
+void RaveAP::releaseRetiredEngine() {
+  std::lock_guard<std::mutex> lock(_retiredEngineLock);
+  if (!_hasRetiredEngine.load())
+    return;
+  // freed at the end of this scope, unless the editor still holds it
+  auto engine = _retiredEngine.exchange(nullptr);
+  _hasRetiredEngine.store(false);
+}
+
+void RaveAP::addEngineListener(juce::ChangeListener *listener) {
+  _engineBroadcaster.addChangeListener(listener);
+}
+
+void RaveAP::removeEngineListener(juce::ChangeListener *listener) {
+  _engineBroadcaster.removeChangeListener(listener);
 }
 
 void RaveAP::updateEngine(const std::string modelFile) {
@@ -322,3 +733,17 @@ void RaveAP::updateEngine(const std::string modelFile) {
 
   _engineThreadPool->addJob(new UpdateEngineJob(*this, modelFile), true);
 }
+
+void RaveAP::tuneExecutor(const std::string &modelFile, Precision precision) {
+  // timings taken while rendering offline would not be representative, and
+  // the renderer does not wait for them anyway
+  if (isNonRealtime())
+    return;
+  // tuned for this instance, which is given no more than its share
+  const int share = _threadShare.getShare();
+  _tuningThreadPool->addJob(
+      new ExecutorTuneJob(juce::File(modelFile), precision,
+                          share > 0 ? share
+                                    : ThreadBudget::getInstance().getBudget()),
+      true);
+}
@@ -0,0 +1,271 @@
+#include "Precision.h"
+#include <ATen/core/dispatch/Dispatcher.h>
+#include <algorithm>
+#include <torch/csrc/jit/ir/constants.h>
+#include <torch/csrc/jit/ir/ir.h>
+#include <torch/csrc/jit/passes/dead_code_elimination.h>
+#include <torch/csrc/jit/passes/graph_rewrite_helper.h>
+
+#if JUCE_INTEL
+#if JUCE_MSVC
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#elif JUCE_LINUX
+#include <sys/auxv.h>
+#ifndef HWCAP2_BF16
+#define HWCAP2_BF16 (1 << 14)
+#endif
+#elif JUCE_MAC
+#include <sys/sysctl.h>
+#endif
+
+namespace {
+using torch::jit::Block;
+using torch::jit::Node;
+using torch::jit::Value;
+
+bool hasBFloat16() {
+#if JUCE_INTEL
+  // eax, ebx, ecx, edx
+  unsigned int regs[4] = {};
+  auto cpuid = [&regs](unsigned int leaf, unsigned int subleaf) {
+#if JUCE_MSVC
+    int r[4];
+    __cpuidex(r, (int)leaf, (int)subleaf);
+    for (int i = 0; i < 4; i++)
+      regs[i] = (unsigned int)r[i];
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+  };
+  cpuid(0, 0);
+  if (regs[0] < 7)
+    return false;
+  cpuid(7, 0);
+  const bool amx = (regs[3] >> 22) & 1;
+  cpuid(7, 1);
+  const bool avx512 = (regs[0] >> 5) & 1;
+  // hasAVX512F also checks that the OS saves the AVX-512 registers
+  return amx || (avx512 && juce::SystemStats::hasAVX512F());
+#elif JUCE_LINUX && JUCE_ARM
+  return (getauxval(AT_HWCAP2) & HWCAP2_BF16) != 0;
+#elif JUCE_MAC && JUCE_ARM
+  int value = 0;
+  size_t size = sizeof(value);
+  return sysctlbyname("hw.optional.arm.FEAT_BF16", &value, &size, nullptr,
+                      0) == 0 &&
+         value != 0;
+#else
+  return false;
+#endif
+}
+
+Value *castTo(torch::jit::Graph &graph, Value *value, at::ScalarType type) {
+  return graph.insert(c10::Symbol::fromQualString("aten::to"), {value, type});
+}
+
+bool isTensor(const Value *value) {
+  return value->type()->cast<c10::TensorType>() != nullptr;
+}
+
+// inputs of the ops holding weights, which must match their type
+void castWeightedInputs(Block *block) {
+  static const std::vector<std::pair<c10::Symbol, size_t>> weighted = {
+      {c10::Symbol::fromQualString("aten::conv1d"), 1},
+      {c10::Symbol::fromQualString("aten::conv2d"), 1},
+      {c10::Symbol::fromQualString("aten::conv_transpose1d"), 1},
+      {c10::Symbol::fromQualString("aten::linear"), 1},
+      {c10::Symbol::fromQualString("aten::matmul"), 2}};
+  for (Node *node : block->nodes()) {
+    for (Block *sub : node->blocks())
+      castWeightedInputs(sub);
+    for (const auto &op : weighted) {
+      if (node->kind() != op.first)
+        continue;
+      torch::jit::WithInsertPoint guard(node);
+      for (size_t i = 0; i < op.second; i++)
+        if (isTensor(node->input(i)))
+          node->replaceInput(
+              i, castTo(*node->owningGraph(), node->input(i), at::kBFloat16));
+    }
+  }
+}
+
+c10::IValue callOperator(const char *name, torch::jit::Stack stack) {
+  auto op = c10::Dispatcher::singleton().findSchemaOrThrow(name, "");
+  op.callBoxed(&stack);
+  return stack.back();
+}
+
+// symmetric, per output channel. Transposed convolutions only support a
+// scale for the whole tensor.
+at::Tensor quantizeWeight(const at::Tensor &weight, bool transposed) {
+  const at::Tensor w = weight.detach().to(at::kFloat).contiguous();
+  if (transposed) {
+    const double scale =
+        std::max(w.abs().max().item<double>(), 1.0e-8) / 127.0;
+    return at::quantize_per_tensor(w, scale, 0, at::kQInt8);
+  }
+  const at::Tensor scales =
+      (w.abs().amax({1, 2}).clamp_min(1.0e-8) / 127.0).to(at::kDouble);
+  return at::quantize_per_channel(w, scales, at::zeros_like(scales, at::kLong),
+                                  0, at::kQInt8);
+}
+
+int quantizeBlock(Block *block) {
+  int quantized = 0;
+  for (auto it = block->nodes().begin(); it != block->nodes().end();) {
+    Node *node = *it++;
+    for (Block *sub : node->blocks())
+      quantized += quantizeBlock(sub);
+
+    // aten::conv1d(input, weight, bias, stride, padding, dilation, groups)
+    // aten::conv_transpose1d(input, weight, bias, stride, padding,
+    //                        output_padding, groups, dilation)
+    const bool transposed =
+        node->kind() == c10::Symbol::fromQualString("aten::conv_transpose1d");
+    if (node->kind() != c10::Symbol::fromQualString("aten::conv1d") &&
+        !transposed)
+      continue;
+    std::vector<c10::IValue> args;
+    for (size_t i = 1; i < node->inputs().size(); i++) {
+      auto value = torch::jit::toIValue(node->input(i));
+      if (!value)
+        break;
+      args.push_back(*value);
+    }
+    // weights computed at run time, or padding="same"
+    if (args.size() != node->inputs().size() - 1 || !args[0].isTensor() ||
+        args[3].isString())
+      continue;
+    const at::Tensor weight = args[0].toTensor();
+    if (weight.dim() != 3)
+      continue;
+    const int64_t outputs = transposed ? weight.size(1) : weight.size(0);
+    const int64_t inputs = transposed ? weight.size(0) : weight.size(1);
+    if (outputs < minQuantizedChannels || inputs < minQuantizedChannels)
+      continue;
+    c10::optional<at::Tensor> bias;
+    if (args[1].isTensor())
+      bias = args[1].toTensor().to(at::kFloat);
+
+    const at::Tensor qweight = quantizeWeight(weight, transposed);
+    const c10::IValue packed =
+        transposed ? callOperator("quantized::conv_transpose1d_prepack",
+                                  {qweight, bias, args[2], args[3], args[4],
+                                   args[6], args[5]})
+                   : callOperator("quantized::conv1d_prepack",
+                                  {qweight, bias, args[2], args[3], args[4],
+                                   args[5]});
+    torch::jit::Graph *graph = node->owningGraph();
+    torch::jit::WithInsertPoint guard(node);
+    torch::jit::Value *packedValue = graph->insertConstant(packed);
+    // reduce_range keeps the accumulators of CPUs without VNNI from
+    // saturating
+    torch::jit::Value *output = graph->insert(
+        c10::Symbol::fromQualString(transposed
+                                        ? "quantized::conv_transpose1d_dynamic"
+                                        : "quantized::conv1d_dynamic"),
+        {node->input(0), packedValue, true});
+    node->output()->replaceAllUsesWith(output);
+    node->destroy();
+    quantized++;
+  }
+  return quantized;
+}
+} // namespace
+
+int quantizeConvolutions(torch::jit::Module &frozen,
+                         const std::vector<std::string> &methods) {
+  TORCH_CHECK(isPrecisionSupported(Precision::int8),
+              "no quantized engine for this CPU");
+  int quantized = 0;
+  for (const auto &name : methods) {
+    auto graph = frozen.get_method(name).graph();
+    // aten::_convolution back to aten::conv1d / conv_transpose1d
+    torch::jit::graph_rewrite_helper::replaceConvolutionWithAtenConv(graph);
+    quantized += quantizeBlock(graph->block());
+    torch::jit::EliminateDeadCode(graph);
+  }
+  return quantized;
+}
+
+juce::String getPrecisionName(Precision precision) {
+  switch (precision) {
+  case Precision::int8:
+    return "int8";
+  case Precision::bfloat16:
+    return "bfloat16";
+  default:
+    return "float32";
+  }
+}
+
+Precision getPrecisionFromName(const juce::String &name) {
+  if (name == "int8")
+    return Precision::int8;
+  if (name == "bfloat16" || name == "bf16")
+    return Precision::bfloat16;
+  return Precision::float32;
+}
+
+bool isPrecisionSupported(Precision precision) {
+  switch (precision) {
+  case Precision::int8:
+    return at::globalContext().qEngine() != at::QEngine::NoQEngine;
+  case Precision::bfloat16: {
+    static const bool supported = hasBFloat16();
+    return supported;
+  }
+  default:
+    return true;
+  }
+}
+
+void castWeightsToBFloat16(torch::jit::Module &module) {
+  for (const auto &param : module.named_parameters(false))
+    if (param.value.is_floating_point())
+      module.setattr(param.name, param.value.to(at::kBFloat16));
+  for (const auto &buf : module.named_buffers(false))
+    if (buf.value.is_floating_point())
+      module.setattr(buf.name, buf.value.to(at::kBFloat16));
+  for (const auto &child : module.named_children()) {
+    torch::jit::Module childModule = child.value;
+    castWeightsToBFloat16(childModule);
+  }
+}
+
+void castBoundaries(torch::jit::Module &frozen,
+                    const std::vector<std::string> &methods) {
+  for (const auto &name : methods) {
+    auto graph = frozen.get_method(name).graph();
+    torch::jit::graph_rewrite_helper::replaceConvolutionWithAtenConv(graph);
+    castWeightedInputs(graph->block());
+    // the first input is the module itself
+    for (size_t i = 1; i < graph->inputs().size(); i++) {
+      Value *input = graph->inputs()[i];
+      if (!isTensor(input))
+        continue;
+      torch::jit::WithInsertPoint guard(graph->block()->nodes().front());
+      Value *cast = castTo(*graph, input, at::kBFloat16);
+      input->replaceAllUsesAfterNodeWith(cast->node(), cast);
+    }
+    Node *output = graph->return_node();
+    for (size_t i = 0; i < output->inputs().size(); i++) {
+      Value *value = output->input(i);
+      if (isTensor(value)) {
+        torch::jit::WithInsertPoint guard(output);
+        output->replaceInput(i, castTo(*graph, value, at::kFloat));
+      } else if (value->node()->kind() == c10::prim::TupleConstruct) {
+        Node *tuple = value->node();
+        torch::jit::WithInsertPoint guard(tuple);
+        for (size_t j = 0; j < tuple->inputs().size(); j++)
+          if (isTensor(tuple->input(j)))
+            tuple->replaceInput(j, castTo(*graph, tuple->input(j), at::kFloat));
+      }
+    }
+    torch::jit::EliminateDeadCode(graph);
+  }
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <JuceHeader.h>
+#include <string>
+#include <torch/script.h>
+#include <vector>
+
+// Number format a model computes in. float32 is the model as exported, the
+// others are obtained from its frozen version (see
+// ModelCache::acquireOptimized). Whatever the precision, the model reads and
+// writes float32 tensors.
+enum class Precision { float32 = 0, int8, bfloat16 };
+
+juce::String getPrecisionName(Precision precision);
+// float32 for unknown names
+Precision getPrecisionFromName(const juce::String &name);
+// Whether this CPU runs precision natively: int8 needs one of libtorch's
+// quantized engines, bfloat16 AVX512-BF16 or AMX on x86, the BF16 extension
+// on Arm. Emulated bfloat16 is slower than float32.
+bool isPrecisionSupported(Precision precision);
+
+// Dynamic int8 quantization of the convolutions of a frozen module: the
+// weights are quantized once, per output channel, and the activations on the
+// fly by each call, using libtorch's quantized::conv1d_dynamic and
+// quantized::conv_transpose1d_dynamic. Only the convolutions whose weights
+// are constants of the graph, i.e. of a frozen module, can be quantized.
+// Thin ones (fewer than minChannels inputs or outputs), such as the layers
+// reading the audio or writing it back, are cheap and the most sensitive to
+// the error: they are left in float.
+//
+// Rewrites the graphs of the given methods in place, before their first
+// call, and returns the number of convolutions quantized. Throws c10::Error
+// if libtorch has no quantized engine for this CPU.
+int quantizeConvolutions(torch::jit::Module &frozen,
+                         const std::vector<std::string> &methods);
+
+constexpr int64_t minQuantizedChannels = 16;
+
+// Casts the floating point parameters and buffers of module to bfloat16, in
+// place. To be frozen afterwards, then given to castBoundaries.
+void castWeightsToBFloat16(torch::jit::Module &module);
+
+// Makes the given methods of a frozen bfloat16 module take and return
+// float32: tensor inputs are cast to bfloat16 on entry, tensor outputs (or
+// the tensors of a returned tuple) back to float32. The inputs of the
+// convolutions and linear layers are cast too, as the graph may create
+// float32 tensors of its own, e.g. noise.
+void castBoundaries(torch::jit::Module &frozen,
+                    const std::vector<std::string> &methods);
@@ -1,32 +1,76 @@
 #pragma once
 
+#include "BatchedDecoder.h"
+#include "ModelCache.h"
+#include "Precision.h"
+#include "Tracer.h"
 #include <torch/script.h>
 #include <torch/torch.h>
 #include <JuceHeader.h>
+#include <map>
 
 #define MAX_LATENT_BUFFER_SIZE 32
 #define BUFFER_LENGTH 32768
+#define DEFAULT_WARMUP_PASSES 3
 using namespace torch::indexing;
 
+// Tensors reused by every frame of a given size, so that the processing
+// thread does not allocate anything besides the model's own outputs.
+struct RaveWorkspace {
+  int frameSize = 0;
+  int nSteps = 0;
+  at::Tensor priorInput;   // {1, 1, nSteps}
+  at::Tensor trajectory;   // {1, latent dims, nSteps}
+  at::Tensor noise;        // {1, latent dims, nSteps}
+  at::Tensor stereoLatent; // {2, full latent dims, nSteps}
+  at::Tensor scale;        // {1, latent dims, 1}
+  at::Tensor bias;         // {1, latent dims, 1}
+
+  // Returns t with the given shape, only reallocating if it has to grow.
+  static at::Tensor &fit(at::Tensor &t, at::IntArrayRef sizes) {
+    if (t.sizes() != sizes)
+      t.resize_(sizes);
+    return t;
+  }
+};
+
+// Duration of a frame's encode / decode, the first time a frame size is
+// performed and once the JIT has settled
+struct WarmUpTiming {
+  int frameSize = 0;
+  double firstMs = 0.0;
+  double steadyMs = 0.0;
+};
+
 class RAVE : public juce::ChangeBroadcaster {
 
 public:
+  // the executor settings are applied around loading, see ExecutorConfig
   RAVE() : juce::ChangeBroadcaster() {
-    torch::jit::getProfilingMode() = false;
-    c10::InferenceMode guard;
-    torch::jit::setGraphExecutorOptimize(true);
     std::cout << "RAVE object created" << std::endl;
   }
 
-  void load_model(const std::string &rave_model_file) {
+  ~RAVE() override { leaveBatch(); }
+
+  // Returns false, leaving the object without a model, if the file cannot
+  // be loaded or is not a RAVE export. The model computes in the requested
+  // precision if it and the CPU allow it, see getPrecision. The methods of a
+  // shared module are compiled by its first user: executor tells apart the
+  // ones compiled with other executor settings, see ExecutorConfig.
+  bool load_model(const std::string &rave_model_file,
+                  Precision requested = Precision::float32,
+                  const std::string &executor = {}) {
+    RAVE_TRACE("load_model");
     try {
-      c10::InferenceMode guard;
-      this->model = torch::jit::load(rave_model_file);
+      // the module may be shared with other instances, see ModelCache
+      this->shared_model =
+          ModelCache::getInstance().acquire(rave_model_file, executor);
+      this->model = *this->shared_model;
     } catch (const c10::Error &e) {
       std::cerr << e.what();
       std::cerr << e.msg();
       std::cerr << "error loading the model\n";
-      return;
+      return false;
     }
 
     this->model_path = juce::String(rave_model_file);
@@ -62,6 +106,41 @@ public:
       stereo = false;
     }
 
+    // Streaming exports use cached convolutions, which keep their padding in
+    // buffers and therefore their state from one call to the next
+    this->streaming = false;
+    bool found_streaming_attribute = false;
+    for (auto const& attr : named_attributes) {
+      if ((attr.name == "streaming" || attr.name == "_rave.streaming") &&
+          attr.value.isBool()) {
+        found_streaming_attribute = true;
+        this->streaming = attr.value.toBool();
+      }
+    }
+    if (!found_streaming_attribute) {
+      for (auto const& buf : named_buffers) {
+        const std::string suffix = ".pad";
+        if (buf.name == "pad" ||
+            (buf.name.size() > suffix.size() &&
+             buf.name.compare(buf.name.size() - suffix.size(), suffix.size(),
+                              suffix) == 0)) {
+          this->streaming = true;
+          break;
+        }
+      }
+    }
+    std::cout << "\tStreaming: " << this->streaming << std::endl;
+    // cached convolutions are per instance, only the weights are shared
+    if (this->streaming) {
+      try {
+        this->model = ModelCache::instantiate(*this->shared_model);
+      } catch (const c10::Error &e) {
+        std::cerr << e.what();
+        std::cerr << "error instantiating the model\n";
+        return false;
+      }
+    }
+
     if (found_model_as_attribute) {
       // Use named buffers within _rave
       for (auto const& buf : named_buffers) {
@@ -119,25 +198,196 @@ public:
       }
     }
 
+    if (!hasMethod("encode") || !hasMethod("decode") ||
+        !encode_params.defined() || !decode_params.defined()) {
+      std::cerr << "[-] RAVE - " << rave_model_file
+                << " does not look like a RAVE model\n";
+      return false;
+    }
+
+    // cache metadata as plain ints, so that they are not read back from
+    // tensors on the processing thread
+    this->model_ratio = encode_params.index({3}).item<int>();
+    this->latent_dims = decode_params.index({0}).item<int>();
+    this->encode_channels = encode_params.index({0}).item<int>();
+    this->encode_latent_dims = encode_params.index({2}).item<int>();
+    this->decode_channels = decode_params.index({3}).item<int>();
+    this->input_batches = encode_params.index({1}).item<int>();
+    this->output_batches = decode_params.index({3}).item<int>();
+
     std::cout << "\tFull latent size: " << getFullLatentDimensions()
               << std::endl;
     std::cout << "\tRatio: " << getModelRatio() << std::endl;
     c10::InferenceMode guard;
     inputs_rave.clear();
     inputs_rave.push_back(torch::ones({1, 1, getModelRatio()}));
+    // streaming models keep their state in buffers, which freezing would
+    // share between the instances
+    this->precision = Precision::float32;
+    this->precision_deviation = 0.0;
+    const bool supported = isPrecisionSupported(requested);
+    if (!supported)
+      std::cerr << "[-] RAVE - " << getPrecisionName(requested)
+                << " is not supported by this CPU\n";
+    if (!this->streaming &&
+        !(requested != Precision::float32 && supported &&
+          useOptimizedModel(rave_model_file, requested, executor)))
+      useOptimizedModel(rave_model_file, Precision::float32, executor);
+    if (requested != this->precision)
+      std::cerr << "[-] RAVE - cannot run the model in "
+                << getPrecisionName(requested) << ", running it in float32\n";
+    latent_buffer = torch::zeros({1, encode_latent_dims, MAX_LATENT_BUFFER_SIZE});
+    latent_scratch = torch::zeros_like(latent_buffer);
+    buildWorkspaces();
     resetLatentBuffer();
+    loaded = true;
     sendChangeMessage();
+    return true;
+  }
+
+  bool isLoaded() const { return loaded; }
+
+  // Rate the model was trained at, 0 if unknown
+  int getSamplingRate() const { return sr; }
+
+  // Decode together with the other instances running the same model, see
+  // BatchedDecoder. Takes effect on the next decode call.
+  void setBatchedDecode(bool enabled) { batch_requested.store(enabled); }
+  // Stops the other instances from waiting for this one, until its next
+  // decode call, e.g. while muted. From the thread calling decode.
+  void leaveBatch() {
+    if (batch_joined)
+      BatchedDecoder::getInstance().leave(this);
+    batch_joined = false;
+  }
+
+  // Runs passes silent frames of the given size through the methods used
+  // while playing, so that the first frame played does not pay for the
+  // JIT's profiling and specialization on that shape. Returns false if the
+  // model fails to process it.
+  bool warmUp(int frameSize, int passes = DEFAULT_WARMUP_PASSES) {
+    RAVE_TRACE("warmUp");
+    RaveWorkspace *ws = getWorkspace(frameSize);
+    if (!loaded || ws == nullptr)
+      return false;
+    WarmUpTiming timing;
+    timing.frameSize = frameSize;
+    try {
+      c10::InferenceMode guard;
+      at::Tensor input = torch::zeros({1, 1, frameSize});
+      double steadyTotal = 0.0;
+      for (int pass = 0; pass < std::max(1, passes); pass++) {
+        const double elapsed = timeFrame(*ws, input);
+        if (pass == 0)
+          timing.firstMs = elapsed;
+        else
+          steadyTotal += elapsed;
+      }
+      timing.steadyMs =
+          passes > 1 ? steadyTotal / (passes - 1) : timing.firstMs;
+    } catch (const c10::Error &e) {
+      std::cerr << e.what();
+      std::cerr << "[-] RAVE - warm-up failed for frame size " << frameSize
+                << "\n";
+      return false;
+    }
+    std::cout << "\tWarm-up " << frameSize << ": first " << timing.firstMs
+              << " ms, steady " << timing.steadyMs << " ms" << std::endl;
+    warmup_timings.push_back(timing);
+    return true;
+  }
+
+  // Runs input through the methods used while playing, as one frame of
+  // ws's size, and returns how long it took in ms. Throws c10::Error if the
+  // model fails to process it.
+  double timeFrame(RaveWorkspace &ws, const at::Tensor &input) {
+    c10::InferenceMode guard;
+    const double start = juce::Time::getMillisecondCounterHiRes();
+    at::Tensor latent = hasMethod("encode_amortized")
+                            ? encode_amortized(input)[0]
+                            : encode(input);
+    if (hasPrior())
+      sample_prior(ws, 1.f);
+    if (isStereo() && latent.size(1) < getFullLatentDimensions())
+      latent = torch::zeros({2, getFullLatentDimensions(), latent.size(2)});
+    decode(latent);
+    return juce::Time::getMillisecondCounterHiRes() - start;
   }
 
-  torch::Tensor sample_prior(const int n_steps, const float temperature) {
+  // Replaces the module with a copy of its own, whose methods are compiled
+  // again on their next call, e.g. with other executor settings. The weights
+  // are copied too.
+  void recompile() {
     c10::InferenceMode guard;
-    inputs_rave[0] = torch::ones({1, 1, n_steps}) * temperature;
+    this->model = this->model.clone();
+  }
+
+  // Torch threads found to be the fastest for each frame size, see
+  // ExecutorTuning. Set before the engine is published.
+  void setTunedThreads(const std::map<int, int> &threads) {
+    tuned_threads = threads;
+  }
+  // 0 if the frame size was not tuned
+  int getTunedThreads(int frameSize) const {
+    auto it = tuned_threads.find(frameSize);
+    return it != tuned_threads.end() ? it->second : 0;
+  }
+
+  // Warms every valid frame size up, i.e. every latency mode the user may
+  // switch to. Returns the number of sizes that could be performed.
+  int warmUpAll(int passes = DEFAULT_WARMUP_PASSES) {
+    warmup_timings.clear();
+    int warmed = 0;
+    for (const auto &ws : workspaces)
+      warmed += warmUp(ws.frameSize, passes) ? 1 : 0;
+    return warmed;
+  }
+
+  // First call and steady-state timings of each warmed-up frame size
+  const std::vector<WarmUpTiming> &getWarmUpTimings() const {
+    return warmup_timings;
+  }
+
+  // One workspace per valid frame size, i.e. per latency mode
+  void buildWorkspaces() {
+    c10::InferenceMode guard;
+    workspaces.clear();
+    for (int frameSize = getModelRatio(); frameSize <= BUFFER_LENGTH;
+         frameSize *= 2) {
+      RaveWorkspace ws;
+      ws.frameSize = frameSize;
+      ws.nSteps = frameSize / getModelRatio();
+      ws.priorInput = torch::ones({1, 1, ws.nSteps});
+      ws.trajectory = torch::zeros({1, encode_latent_dims, ws.nSteps});
+      ws.noise = torch::zeros({1, encode_latent_dims, ws.nSteps});
+      ws.stereoLatent =
+          torch::zeros({2, getFullLatentDimensions(), ws.nSteps});
+      ws.scale = torch::ones({1, encode_latent_dims, 1});
+      ws.bias = torch::zeros({1, encode_latent_dims, 1});
+      workspaces.push_back(ws);
+    }
+  }
+
+  // nullptr if no model is loaded or the frame size is not valid for it
+  RaveWorkspace *getWorkspace(int frameSize) {
+    for (auto &ws : workspaces)
+      if (ws.frameSize == frameSize)
+        return &ws;
+    return nullptr;
+  }
+
+  torch::Tensor sample_prior(RaveWorkspace &ws, const float temperature) {
+    RAVE_TRACE("sample_prior");
+    c10::InferenceMode guard;
+    ws.priorInput.fill_(temperature);
+    inputs_rave[0] = ws.priorInput;
     torch::Tensor prior =
         this->model.get_method("prior")(inputs_rave).toTensor();
     return prior;
   }
 
   torch::Tensor encode(const torch::Tensor input) {
+    RAVE_TRACE("encode");
     c10::InferenceMode guard;
     inputs_rave[0] = input;
     auto y = this->model.get_method("encode")(inputs_rave).toTensor();
@@ -145,6 +395,7 @@ public:
   }
 
   std::vector<torch::Tensor> encode_amortized(const torch::Tensor input) {
+    RAVE_TRACE("encode_amortized");
     c10::InferenceMode guard;
     inputs_rave[0] = input;
     auto stats = this->model.get_method("encode_amortized")(inputs_rave)
@@ -158,9 +409,31 @@ public:
   }
 
   torch::Tensor decode(const torch::Tensor input) {
+    RAVE_TRACE("decode");
     c10::InferenceMode guard;
+    // streaming models carry their own state and cannot share a batch
+    const bool batched = batch_requested.load() && !streaming;
+    if (!batched)
+      leaveBatch();
+    if (batched) {
+      batch_joined = true;
+      const int64_t frameSize = input.size(2) * getModelRatio();
+      const auto frameDuration = std::chrono::microseconds(
+          sr > 0 ? frameSize * 1000000 / sr : 0);
+      return BatchedDecoder::getInstance().decode(
+          shared_model, this, input, decode_batch_dim, frameDuration);
+    }
     inputs_rave[0] = input;
     auto y = this->model.get_method("decode")(inputs_rave).toTensor();
+    // The batch is the first dimension of the output, except on Windows
+    // where the first two come swapped (see performFrame). A batch of one
+    // tells them apart unless the model is mono.
+    if (input.size(0) == 1 && y.dim() >= 2) {
+      if (y.size(0) != 1)
+        decode_batch_dim = 1;
+      else if (y.size(1) != 1)
+        decode_batch_dim = 0;
+    }
     return y;
   }
 
@@ -169,51 +442,71 @@ public:
   }
 
   unsigned int getLatentDimensions() {
-    int tmp = decode_params.index({0}).item<int>();
-    assert(tmp >= 0);
-    return (unsigned int)tmp;
+    assert(latent_dims >= 0);
+    return (unsigned int)latent_dims;
   }
 
   unsigned int getEncodeChannels() {
-    int tmp = encode_params.index({0}).item<int>();
-    assert(tmp >= 0);
-    return (unsigned int)tmp;
+    assert(encode_channels >= 0);
+    return (unsigned int)encode_channels;
   }
 
   unsigned int getDecodeChannels() {
-    int tmp = decode_params.index({3}).item<int>();
-    assert(tmp >= 0);
-    return (unsigned int)tmp;
+    assert(decode_channels >= 0);
+    return (unsigned int)decode_channels;
   }
 
-  int getModelRatio() { return encode_params.index({3}).item<int>(); }
+  int getModelRatio() { return model_ratio; }
 
-  float zPerSeconds() { return encode_params.index({3}).item<float>() / sr; }
+  float zPerSeconds() { return (float)model_ratio / sr; }
 
   int getFullLatentDimensions() { return latent_size; }
 
-  int getInputBatches() { return encode_params.index({1}).item<int>(); }
+  int getInputBatches() { return input_batches; }
 
-  int getOutputBatches() { return decode_params.index({3}).item<int>(); }
+  int getOutputBatches() { return output_batches; }
 
-  void resetLatentBuffer() { latent_buffer = torch::zeros({0}); }
+  void resetLatentBuffer() {
+    c10::InferenceMode guard;
+    if (latent_buffer.defined())
+      latent_buffer.zero_();
+  }
 
-  void writeLatentBuffer(at::Tensor latent) {
-    if (latent_buffer.size(0) == 0) {
-      latent_buffer = latent;
-    } else {
-      latent_buffer = torch::cat({latent_buffer, latent}, 2);
-    }
-    if (latent_buffer.size(2) > MAX_LATENT_BUFFER_SIZE) {
-      latent_buffer = latent_buffer.index(
-          {"...", Slice(-MAX_LATENT_BUFFER_SIZE, None, None)});
+  // Shifts the latent history left and appends latent at its end, in place,
+  // so that readers always see the same MAX_LATENT_BUFFER_SIZE long tensor.
+  void writeLatentBuffer(const at::Tensor &latent) {
+    c10::InferenceMode guard;
+    if (!latent_buffer.defined() || latent.size(1) != latent_buffer.size(1))
+      return;
+    const int64_t n = latent.size(2);
+    const int64_t cap = MAX_LATENT_BUFFER_SIZE;
+    if (n >= cap) {
+      latent_buffer.copy_(latent.narrow(2, n - cap, cap));
+      return;
     }
+    latent_scratch.narrow(2, 0, cap - n)
+        .copy_(latent_buffer.narrow(2, n, cap - n));
+    latent_buffer.narrow(2, 0, cap - n)
+        .copy_(latent_scratch.narrow(2, 0, cap - n));
+    latent_buffer.narrow(2, cap - n, n).copy_(latent);
   }
 
   bool hasPrior() { return has_prior; }
 
   bool isStereo() const { return stereo; }
 
+  // Streaming models can be fed consecutive hops of any multiple of the
+  // ratio without discontinuities, as they carry their context over.
+  bool isStreaming() const { return streaming; }
+
+  // Smallest valid frame size holding a whole host block
+  int getStreamingFrameSize(int blockSize) {
+    int frameSize = getModelRatio();
+    while (frameSize < blockSize && frameSize < BUFFER_LENGTH)
+      frameSize *= 2;
+    return frameSize;
+  }
+
   at::Tensor getLatentBuffer() { return latent_buffer; }
 
   bool hasMethod(const std::string& method_name) const {
@@ -222,17 +515,97 @@ public:
 
   juce::String getModelPath() { return model_path; } 
 
+  // what the model actually computes in, see load_model
+  Precision getPrecision() const { return precision; }
+  // Relative distance between the latents of the model in its precision and
+  // of the exported one, on a sine. 0 in float32.
+  double getPrecisionDeviation() const { return precision_deviation; }
+
 private:
+  // Swaps the exported module for its frozen and optimized version, see
+  // ModelCache::acquireOptimized, unless it cannot process a frame
+  bool useOptimizedModel(const std::string &rave_model_file,
+                         Precision target, const std::string &executor) {
+    RAVE_TRACE("optimize");
+    std::vector<std::string> methods;
+    for (const std::string method :
+         {"forward", "encode", "decode", "prior", "encode_amortized"})
+      if (hasMethod(method))
+        methods.push_back(method);
+    try {
+      c10::InferenceMode guard;
+      auto optimized = ModelCache::getInstance().acquireOptimized(
+          rave_model_file, *this->shared_model, methods, target, executor);
+      std::vector<torch::jit::IValue> input = {
+          torch::zeros({1, 1, getModelRatio()})};
+      at::Tensor latent =
+          optimized->get_method("encode")(input).toTensor();
+      if (isStereo() && latent.size(1) < getFullLatentDimensions())
+        latent = torch::zeros({2, getFullLatentDimensions(), latent.size(2)});
+      input[0] = latent;
+      optimized->get_method("decode")(input);
+      if (target != Precision::float32) {
+        std::vector<torch::jit::IValue> probe = {
+            torch::sin(torch::arange(getModelRatio() * 16, torch::kFloat) *
+                       0.05)
+                .reshape({1, 1, -1})};
+        const at::Tensor expected =
+            this->shared_model->get_method("encode")(probe).toTensor();
+        const at::Tensor actual =
+            optimized->get_method("encode")(probe).toTensor().to(torch::kFloat);
+        this->precision_deviation =
+            ((actual - expected).norm() / expected.norm().clamp_min(1e-8))
+                .item<double>();
+      }
+      this->shared_model = optimized;
+      this->model = *optimized;
+    } catch (const c10::Error &e) {
+      std::cerr << e.what();
+      if (target == Precision::float32)
+        std::cerr << "[-] RAVE - cannot optimize the model, running it as "
+                     "exported\n";
+      return false;
+    }
+    this->precision = target;
+    std::cout << "\tOptimized: 1, " << getPrecisionName(target) << std::endl;
+    if (target != Precision::float32)
+      std::cout << "\tDeviation from float32: " << precision_deviation
+                << std::endl;
+    return true;
+  }
+
   torch::jit::Module model;
-  int sr;
+  // keeps the cached module alive for as long as this engine uses it
+  ModelCache::ModulePtr shared_model;
+  int sr = 0;
   int latent_size;
+  int model_ratio = 0;
+  int latent_dims = 0;
+  int encode_channels = 0;
+  int encode_latent_dims = 0;
+  int decode_channels = 0;
+  int input_batches = 0;
+  int output_batches = 0;
+  bool loaded = false;
+  std::atomic<bool> batch_requested{false};
+  bool batch_joined = false;
+  // batch dimension of the output of decode, -1 until known
+  int64_t decode_batch_dim = -1;
   bool has_prior = false;
   bool stereo = false;
+  bool streaming = false;
+  Precision precision = Precision::float32;
+  double precision_deviation = 0.0;
   juce::String model_path;
   at::Tensor encode_params;
   at::Tensor decode_params;
   at::Tensor prior_params;
+  // undefined until a model is loaded
   at::Tensor latent_buffer;
+  at::Tensor latent_scratch;
+  std::vector<RaveWorkspace> workspaces;
+  std::vector<WarmUpTiming> warmup_timings;
+  std::map<int, int> tuned_threads;
   std::vector<torch::jit::IValue> inputs_rave;
   juce::Range<float> validBufferSizeRange;
 };
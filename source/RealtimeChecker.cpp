@@ -0,0 +1,103 @@
+#include "RealtimeChecker.h"
+
+#if RAVE_REALTIME_CHECKS
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#if defined(__GLIBC__)
+#include <dlfcn.h>
+#include <pthread.h>
+#define RT_CHECK_TLS __attribute__((tls_model("initial-exec"))) thread_local
+#else
+#define RT_CHECK_TLS thread_local
+#endif
+
+namespace {
+RT_CHECK_TLS int realtimeDepth = 0;
+RT_CHECK_TLS int bypassDepth = 0;
+
+inline void checkRealtime(const char *what) {
+  if (realtimeDepth > 0 && bypassDepth == 0) {
+    bypassDepth++;
+    std::fprintf(stderr, "[-] RAVE - %s called on the audio thread\n", what);
+    std::fflush(stderr);
+    std::abort();
+  }
+}
+} // namespace
+
+namespace rt_check {
+ScopedRealtimeSection::ScopedRealtimeSection() { realtimeDepth++; }
+ScopedRealtimeSection::~ScopedRealtimeSection() { realtimeDepth--; }
+ScopedRealtimeBypass::ScopedRealtimeBypass() { bypassDepth++; }
+ScopedRealtimeBypass::~ScopedRealtimeBypass() { bypassDepth--; }
+} // namespace rt_check
+
+#if defined(__GLIBC__)
+// Interpose the C allocator and pthread mutexes. This only catches calls
+// resolved through the global symbol scope, which is the case for the
+// Standalone executable; plugin hosts usually keep glibc first.
+extern "C" {
+void *__libc_malloc(size_t);
+void *__libc_calloc(size_t, size_t);
+void *__libc_realloc(void *, size_t);
+void __libc_free(void *);
+
+void *malloc(size_t size) {
+  checkRealtime("malloc");
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+  checkRealtime("calloc");
+  return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+  checkRealtime("realloc");
+  return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+  if (ptr != nullptr)
+    checkRealtime("free");
+  __libc_free(ptr);
+}
+
+using MutexLockFn = int (*)(pthread_mutex_t *);
+static MutexLockFn nextMutexLock =
+    (MutexLockFn)dlsym(RTLD_NEXT, "pthread_mutex_lock");
+
+int pthread_mutex_lock(pthread_mutex_t *mutex) {
+  checkRealtime("pthread_mutex_lock");
+  if (nextMutexLock == nullptr)
+    nextMutexLock = (MutexLockFn)dlsym(RTLD_NEXT, "pthread_mutex_lock");
+  return nextMutexLock(mutex);
+}
+}
+#endif
+
+void *operator new(std::size_t size) {
+  checkRealtime("operator new");
+  if (void *ptr = std::malloc(size == 0 ? 1 : size))
+    return ptr;
+  throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size) { return operator new(size); }
+
+void operator delete(void *ptr) noexcept {
+  if (ptr != nullptr)
+    checkRealtime("operator delete");
+  std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept { operator delete(ptr); }
+
+void operator delete(void *ptr, std::size_t) noexcept { operator delete(ptr); }
+
+void operator delete[](void *ptr, std::size_t) noexcept {
+  operator delete(ptr);
+}
+#endif
@@ -0,0 +1,30 @@
+#pragma once
+
+// Test helper catching non real-time safe calls on the audio thread. In
+// rave-realtime-test, built with -DRAVE_REALTIME_CHECKS=ON, any heap
+// allocation (operator new / delete, and malloc / free / mutex locks on glibc)
+// made while a ScopedRealtimeSection is alive is reported and aborts the
+// process, so that the test fails loudly.
+// Everywhere else, the plugin included, everything here compiles to nothing.
+namespace rt_check {
+
+#if RAVE_REALTIME_CHECKS
+class ScopedRealtimeSection {
+public:
+  ScopedRealtimeSection();
+  ~ScopedRealtimeSection();
+};
+
+// Runs a block of code that is allowed to allocate even inside a real-time
+// section (e.g. deliberate debug prints).
+class ScopedRealtimeBypass {
+public:
+  ScopedRealtimeBypass();
+  ~ScopedRealtimeBypass();
+};
+#else
+class ScopedRealtimeSection {};
+class ScopedRealtimeBypass {};
+#endif
+
+} // namespace rt_check
@@ -0,0 +1,158 @@
+#include "Resampler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <numeric>
+
+namespace {
+constexpr double pi = 3.14159265358979323846;
+
+// floor(a / b) for b > 0
+inline int64_t floorDiv(int64_t a, int64_t b) {
+  return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+// Modified Bessel function of the first kind, order 0
+double besselI0(double x) {
+  double sum = 1.0, term = 1.0;
+  for (int k = 1; k < 50; k++) {
+    term *= (x / (2.0 * k)) * (x / (2.0 * k));
+    sum += term;
+    if (term < 1e-12 * sum)
+      break;
+  }
+  return sum;
+}
+
+// Eight independent partial sums, which the compiler maps to SIMD lanes
+// without needing to reorder a single floating point accumulation.
+inline float dot(const float *h, const float *x) {
+  float acc[8] = {0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f};
+  for (int t = 0; t < Resampler::taps; t += 8)
+    for (int k = 0; k < 8; k++)
+      acc[k] += h[t + k] * x[t + k];
+  return ((acc[0] + acc[4]) + (acc[1] + acc[5])) +
+         ((acc[2] + acc[6]) + (acc[3] + acc[7]));
+}
+} // namespace
+
+static_assert(Resampler::taps % 8 == 0, "dot() works on blocks of 8 taps");
+
+void Resampler::prepare(double inputRate, double outputRate) {
+  const int64_t in = std::llround(inputRate);
+  const int64_t out = std::llround(outputRate);
+  if (in <= 0 || out <= 0 || in == out) {
+    _up = _down = 1;
+  } else {
+    const int64_t g = std::gcd(in, out);
+    _up = (int)(out / g);
+    _down = (int)(in / g);
+    if (std::max(_up, _down) > maxPhases) {
+      // odd rates: closest ratio with both terms bounded. Scaling the larger
+      // one to maxPhases gives the exact inverse for the other direction,
+      // so that host to model and back keeps the same number of samples.
+      if (_up > _down) {
+        _down = (int)std::max<int64_t>(
+            1, std::llround((double)_down * maxPhases / _up));
+        _up = maxPhases;
+      } else {
+        _up = (int)std::max<int64_t>(
+            1, std::llround((double)_up * maxPhases / _down));
+        _down = maxPhases;
+      }
+      const int r = std::gcd(_up, _down);
+      _up /= r;
+      _down /= r;
+      std::cout << "[ ] - resampling " << in << " Hz to " << out
+                << " Hz approximated as " << _up << "/" << _down
+                << std::endl;
+    }
+  }
+
+  // prototype low-pass at the upsampled rate, cut a bit below the lowest
+  // of the two Nyquist frequencies
+  const int length = taps * _up;
+  const double cutoff = 0.5 * 0.92 / std::max(_up, _down);
+  const double beta = 8.6;
+  const double center = (length - 1) / 2.0;
+  std::vector<double> prototype(length);
+  for (int k = 0; k < length; k++) {
+    const double x = k - center;
+    const double sinc = x == 0.0 ? 2.0 * cutoff
+                                 : std::sin(2.0 * pi * cutoff * x) /
+                                       (pi * x);
+    const double r = length > 1 ? 2.0 * x / (length - 1) : 0.0;
+    const double window =
+        besselI0(beta * std::sqrt(std::max(0.0, 1.0 - r * r))) /
+        besselI0(beta);
+    prototype[k] = sinc * window;
+  }
+
+  // split in phases, each normalized to unit gain at DC
+  _filters.assign((size_t)_up * taps, 0.f);
+  for (int p = 0; p < _up; p++) {
+    double sum = 0.0;
+    for (int t = 0; t < taps; t++)
+      sum += prototype[t * _up + p];
+    for (int t = 0; t < taps; t++)
+      _filters[p * taps + (taps - 1 - t)] =
+          (float)(prototype[t * _up + p] / (sum != 0.0 ? sum : 1.0));
+  }
+  _joint.assign(2 * taps, 0.f);
+  reset();
+}
+
+void Resampler::reset() {
+  _pos = 0;
+  std::fill(_joint.begin(), _joint.end(), 0.f);
+}
+
+int Resampler::outputFor(int nIn) const {
+  const int64_t span = (int64_t)nIn * _up - _pos;
+  return span <= 0 ? 0 : (int)((span + _down - 1) / _down);
+}
+
+int Resampler::inputFor(int nOut) const {
+  if (nOut <= 0)
+    return 0;
+  return (int)std::max<int64_t>(
+      0, floorDiv((int64_t)(nOut - 1) * _down + _pos, _up) + 1);
+}
+
+int Resampler::process(const float *in, int nIn, float *out, int maxOut) {
+  if (!isActive()) {
+    const int n = std::min(nIn, maxOut);
+    std::memcpy(out, in, n * sizeof(float));
+    return n;
+  }
+  // the first outputs reach back into the previous block: their inputs are
+  // read from the history followed by the head of this block
+  const int head = std::min(nIn, taps);
+  std::memcpy(_joint.data() + taps, in, head * sizeof(float));
+
+  int produced = 0;
+  while (produced < maxOut) {
+    const int64_t base = floorDiv(_pos, _up);
+    if (base >= nIn)
+      break;
+    const int phase = (int)(_pos - base * _up);
+    const int64_t first = base - taps + 1;
+    const float *x = first >= 0 ? in + first : _joint.data() + taps + first;
+    out[produced++] = dot(_filters.data() + (size_t)phase * taps, x);
+    _pos += _down;
+  }
+  _pos -= (int64_t)nIn * _up;
+  // only reached if the output was limited with too much input
+  _pos = std::max<int64_t>(_pos, -_up);
+
+  // keep the last taps input samples
+  if (nIn >= taps) {
+    std::memcpy(_joint.data(), in + nIn - taps, taps * sizeof(float));
+  } else {
+    std::memmove(_joint.data(), _joint.data() + nIn,
+                 (taps - nIn) * sizeof(float));
+    std::memcpy(_joint.data() + taps - nIn, in, nIn * sizeof(float));
+  }
+  return produced;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// Streaming polyphase resampler for a rational ratio up / down, with a
+// Kaiser-windowed sinc prototype of taps coefficients per phase. The phase
+// is kept across calls, so consecutive blocks of any size resample as one
+// continuous signal.
+//
+// Ratios needing more than maxPhases phases in either direction are
+// approximated, the same way for a rate pair and its inverse.
+//
+// prepare() allocates, everything else is real-time safe.
+class Resampler {
+public:
+  static constexpr int taps = 32;
+  static constexpr int maxPhases = 1024;
+
+  void prepare(double inputRate, double outputRate);
+  void reset();
+  bool isActive() const { return _up != _down; }
+  // output samples per input sample
+  double getRatio() const { return (double)_up / _down; }
+
+  // Output samples the next process() call gives for nIn input samples
+  int outputFor(int nIn) const;
+  // Input samples the next process() call needs to give exactly nOut
+  // output samples
+  int inputFor(int nOut) const;
+  // Resamples nIn samples into out and returns how many were written, at
+  // most maxOut. When limiting the output, nIn must be inputFor(maxOut).
+  int process(const float *in, int nIn, float *out, int maxOut);
+
+  // Group delay of the filter, in input and in output samples
+  double getInputDelay() const {
+    return isActive() ? (taps * _up - 1) / (2.0 * _up) : 0.0;
+  }
+  double getOutputDelay() const {
+    return isActive() ? (taps * _up - 1) / (2.0 * _down) : 0.0;
+  }
+
+private:
+  int _up = 1;
+  int _down = 1;
+  // position of the next output, in input samples times _up, relative to
+  // the first sample of the next input block
+  int64_t _pos = 0;
+  // _up filters of taps coefficients, time-reversed
+  std::vector<float> _filters;
+  // last taps input samples, followed by room for the first taps of the
+  // next block
+  std::vector<float> _joint;
+};
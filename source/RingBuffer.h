@@ -0,0 +1,186 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+
+// Wait-free single-producer / single-consumer ring buffer.
+// put() / put_zeros() / write_span() / commit_write() must only be called from
+// the producer thread, get() / discard() / read_span() / reset() only from the
+// consumer thread; len() and space() can be read from anywhere. The capacity
+// is rounded up to a power of two so that wrapping is a mask, and read and
+// write indices live on separate cache lines.
+//
+// When initialized with a max_span, the first max_span elements are mirrored
+// right after the end of the storage, so that any region of up to max_span
+// elements can be accessed as one contiguous array (e.g. wrapped in a tensor)
+// through read_span() and write_span().
+template <class T> class ring_buffer {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "ring_buffer copies its elements with memcpy");
+  static constexpr size_t cache_line_size = 64;
+
+public:
+  ring_buffer() = default;
+
+  // Allocates the storage. Not real-time safe, call from prepareToPlay.
+  void initialize(size_t size, size_t max_span = 0);
+  size_t capacity() const { return _mask + 1; }
+  size_t len() const;
+  size_t space() const;
+  bool empty() const { return len() == 0; }
+  bool full() const { return space() == 0; }
+
+  // Producer side. Returns the number of elements actually written, which is
+  // less than N if the buffer does not have enough room.
+  size_t put(const T *input_array, size_t N);
+  size_t put_zeros(size_t N);
+  // Contiguous writable region of N <= max_span elements, or nullptr if there
+  // is not enough room. Its content is published by commit_write(N).
+  T *write_span(size_t N);
+  void commit_write(size_t N);
+
+  // Consumer side. get() always writes N elements, padding with zeros when
+  // less than N are readable, and returns the number of elements read.
+  size_t get(T *output_array, size_t N);
+  size_t discard(size_t N);
+  // Contiguous view over the N <= max_span oldest elements, or nullptr if
+  // less than N are readable. They stay valid until discarded.
+  const T *read_span(size_t N) const;
+  size_t reset();
+
+private:
+  template <class Fn> size_t write(size_t N, Fn &&copy);
+  void mirror(size_t start, size_t N);
+
+  alignas(cache_line_size) std::atomic<size_t> _write{0};
+  alignas(cache_line_size) std::atomic<size_t> _read{0};
+  alignas(cache_line_size) std::unique_ptr<T[]> _buffer;
+  size_t _mask = size_t(-1);
+  size_t _max_span = 0;
+};
+
+template <class T>
+void ring_buffer<T>::initialize(size_t size, size_t max_span) {
+  size_t capacity = 1;
+  while (capacity < std::max(size, max_span))
+    capacity <<= 1;
+  _buffer = std::make_unique<T[]>(capacity + max_span);
+  _mask = capacity - 1;
+  _max_span = max_span;
+  _write.store(0, std::memory_order_relaxed);
+  _read.store(0, std::memory_order_relaxed);
+}
+
+template <class T> size_t ring_buffer<T>::len() const {
+  return _write.load(std::memory_order_acquire) -
+         _read.load(std::memory_order_acquire);
+}
+
+template <class T> size_t ring_buffer<T>::space() const {
+  if (!_buffer)
+    return 0;
+  return capacity() - len();
+}
+
+template <class T>
+template <class Fn>
+size_t ring_buffer<T>::write(size_t N, Fn &&copy) {
+  if (!_buffer)
+    return 0;
+  const size_t w = _write.load(std::memory_order_relaxed);
+  const size_t r = _read.load(std::memory_order_acquire);
+  N = std::min(N, capacity() - (w - r));
+  const size_t start = w & _mask;
+  const size_t first = std::min(N, capacity() - start);
+  copy(_buffer.get() + start, 0, first);
+  copy(_buffer.get(), first, N - first);
+  mirror(start, N);
+  _write.store(w + N, std::memory_order_release);
+  return N;
+}
+
+// Keeps the copy of [0, max_span) past the end of the storage up to date
+// after writing N elements from start.
+template <class T> void ring_buffer<T>::mirror(size_t start, size_t N) {
+  if (_max_span == 0 || N == 0)
+    return;
+  const size_t first = std::min(N, capacity() - start);
+  if (start < _max_span)
+    std::memcpy(_buffer.get() + capacity() + start, _buffer.get() + start,
+                (std::min(start + first, _max_span) - start) * sizeof(T));
+  if (N - first)
+    std::memcpy(_buffer.get() + capacity(), _buffer.get(),
+                std::min(N - first, _max_span) * sizeof(T));
+}
+
+template <class T> T *ring_buffer<T>::write_span(size_t N) {
+  if (!_buffer || N > _max_span || N > space())
+    return nullptr;
+  return _buffer.get() + (_write.load(std::memory_order_relaxed) & _mask);
+}
+
+template <class T> void ring_buffer<T>::commit_write(size_t N) {
+  const size_t w = _write.load(std::memory_order_relaxed);
+  const size_t start = w & _mask;
+  // whatever went past the end of the storage belongs at its beginning
+  if (start + N > capacity())
+    std::memcpy(_buffer.get(), _buffer.get() + capacity(),
+                (start + N - capacity()) * sizeof(T));
+  mirror(start, N);
+  _write.store(w + N, std::memory_order_release);
+}
+
+template <class T>
+size_t ring_buffer<T>::put(const T *input_array, size_t N) {
+  return write(N, [input_array](T *dst, size_t offset, size_t n) {
+    if (n)
+      std::memcpy(dst, input_array + offset, n * sizeof(T));
+  });
+}
+
+template <class T> size_t ring_buffer<T>::put_zeros(size_t N) {
+  return write(N, [](T *dst, size_t, size_t n) { std::fill_n(dst, n, T()); });
+}
+
+template <class T> size_t ring_buffer<T>::get(T *output_array, size_t N) {
+  if (!_buffer) {
+    std::fill_n(output_array, N, T());
+    return 0;
+  }
+  const size_t r = _read.load(std::memory_order_relaxed);
+  const size_t w = _write.load(std::memory_order_acquire);
+  const size_t n = std::min(N, w - r);
+  const size_t start = r & _mask;
+  const size_t first = std::min(n, capacity() - start);
+  if (first)
+    std::memcpy(output_array, _buffer.get() + start, first * sizeof(T));
+  if (n - first)
+    std::memcpy(output_array + first, _buffer.get(), (n - first) * sizeof(T));
+  std::fill_n(output_array + n, N - n, T());
+  _read.store(r + n, std::memory_order_release);
+  return n;
+}
+
+template <class T> size_t ring_buffer<T>::discard(size_t N) {
+  const size_t r = _read.load(std::memory_order_relaxed);
+  const size_t w = _write.load(std::memory_order_acquire);
+  const size_t n = std::min(N, w - r);
+  _read.store(r + n, std::memory_order_release);
+  return n;
+}
+
+template <class T> const T *ring_buffer<T>::read_span(size_t N) const {
+  if (!_buffer || N > _max_span || N > len())
+    return nullptr;
+  return _buffer.get() + (_read.load(std::memory_order_relaxed) & _mask);
+}
+
+// Drops everything readable and returns how many elements that was.
+template <class T> size_t ring_buffer<T>::reset() {
+  const size_t r = _read.load(std::memory_order_relaxed);
+  const size_t w = _write.load(std::memory_order_acquire);
+  _read.store(w, std::memory_order_release);
+  return w - r;
+}
@@ -0,0 +1,98 @@
+#include "ThreadBudget.h"
+#include "ThreadSettings.h"
+#include <algorithm>
+#include <limits>
+
+ThreadBudget &ThreadBudget::getInstance() {
+  static ThreadBudget instance;
+  return instance;
+}
+
+void ThreadBudget::join(Participant &participant) {
+  participant.markActive();
+  {
+    std::lock_guard<std::mutex> lock(_lock);
+    _participants.push_back(&participant);
+  }
+  rebalance(true);
+}
+
+void ThreadBudget::leave(Participant &participant) {
+  {
+    std::lock_guard<std::mutex> lock(_lock);
+    _participants.erase(std::remove(_participants.begin(),
+                                    _participants.end(), &participant),
+                        _participants.end());
+  }
+  rebalance(true);
+}
+
+void ThreadBudget::setFixedThreads(Participant &participant, int threads) {
+  {
+    std::lock_guard<std::mutex> lock(_lock);
+    participant._fixedThreads = std::max(0, threads);
+  }
+  rebalance(true);
+}
+
+int ThreadBudget::getBudget() const {
+  const auto settings = ThreadSettings::getGlobal();
+  if (settings.threadBudget && *settings.threadBudget > 0)
+    return *settings.threadBudget;
+  return std::max(1, juce::SystemStats::getNumPhysicalCpus());
+}
+
+void ThreadBudget::rebalance(bool force) {
+  const juce::uint32 now = juce::Time::getMillisecondCounter();
+  if (!force && now - _lastRebalance.load() < rebalanceMs)
+    return;
+  // frames are performed while we wait, another thread is doing it anyway
+  std::unique_lock<std::mutex> lock(_lock, std::defer_lock);
+  if (force)
+    lock.lock();
+  else if (!lock.try_lock())
+    return;
+  _lastRebalance.store(now);
+
+  // participants with threads of their own keep them, whatever is left is
+  // split evenly between the others, with at least one thread each, and
+  // what a participant cannot use goes to the next ones
+  int budget = getBudget();
+  std::vector<Participant *> sharing;
+  int active = 0;
+  for (auto *participant : _participants) {
+    const bool idle =
+        now - participant->_lastActive.load(std::memory_order_relaxed) >
+        idleMs;
+    if (participant->_fixedThreads > 0) {
+      participant->_share.store(participant->_fixedThreads);
+      if (!idle) {
+        budget -= participant->_fixedThreads;
+        active++;
+      }
+    } else if (!idle) {
+      sharing.push_back(participant);
+      active++;
+    }
+  }
+  _activeCount.store(active);
+  if (sharing.empty())
+    return;
+  auto maxOf = [](const Participant *participant) {
+    const int threads = participant->_maxThreads.load(std::memory_order_relaxed);
+    return threads > 0 ? threads : std::numeric_limits<int>::max();
+  };
+  std::stable_sort(sharing.begin(), sharing.end(),
+                   [&maxOf](const Participant *a, const Participant *b) {
+                     return maxOf(a) < maxOf(b);
+                   });
+  const int n = (int)sharing.size();
+  int available = std::max(budget, n);
+  for (int i = 0; i < n; i++) {
+    const int left = n - i;
+    const int even = available / left + (available % left > 0 ? 1 : 0);
+    const int share = std::max(1, std::min(even, maxOf(sharing[i])));
+    sharing[i]->_share.store(share);
+    available = std::max(available - share, left - 1);
+  }
+}
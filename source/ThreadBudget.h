@@ -0,0 +1,67 @@
+#pragma once
+#include <JuceHeader.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+// Splits a number of cores between the instances of the process, so that
+// their torch threads add up to the machine instead of each of them sizing
+// its pool for the whole machine. Instances that stopped processing, e.g.
+// bypassed ones, no longer get a share. Nothing runs on its own: shares are
+// recomputed when instances come and go, and by the threads performing the
+// frames, at most every rebalanceMs.
+class ThreadBudget {
+public:
+  class Participant {
+  public:
+    // audio thread, every block
+    void markActive() {
+      _lastActive.store(juce::Time::getMillisecondCounter(),
+                        std::memory_order_relaxed);
+    }
+    // torch threads this participant may use, 0 until it has joined
+    int getShare() const { return _share.load(std::memory_order_relaxed); }
+    // threads beyond which this participant gets no faster, e.g. from
+    // ExecutorTuning, 0 if unknown. The rest goes to the others from the
+    // next rebalance on.
+    void setMaxThreads(int threads) {
+      _maxThreads.store(threads, std::memory_order_relaxed);
+    }
+
+  private:
+    friend class ThreadBudget;
+    std::atomic<juce::uint32> _lastActive{0};
+    std::atomic<int> _share{0};
+    std::atomic<int> _maxThreads{0};
+    // threads set by the participant's own settings, taken out of the budget
+    int _fixedThreads = 0;
+  };
+
+  static ThreadBudget &getInstance();
+
+  void join(Participant &participant);
+  void leave(Participant &participant);
+  // 0 to take a share of the budget
+  void setFixedThreads(Participant &participant, int threads);
+  // Recomputes the shares, if the last time is older than rebalanceMs
+  // unless forced
+  void rebalance(bool force = false);
+
+  // cores shared by the instances, from the global thread settings or the
+  // number of physical cores
+  int getBudget() const;
+  int getActiveCount() const { return _activeCount.load(); }
+
+  static constexpr juce::uint32 idleMs = 1000;
+  static constexpr juce::uint32 rebalanceMs = 250;
+
+private:
+  ThreadBudget() = default;
+
+  std::mutex _lock;
+  std::vector<Participant *> _participants;
+  std::atomic<juce::uint32> _lastRebalance{0};
+  std::atomic<int> _activeCount{0};
+
+  JUCE_DECLARE_NON_COPYABLE(ThreadBudget)
+};
@@ -0,0 +1,284 @@
+#include "ThreadSettings.h"
+#include "TorchRuntime.h"
+#include <iostream>
+#include <mutex>
+#include <torch/torch.h>
+
+#if JUCE_WINDOWS
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#if JUCE_LINUX
+#include <sys/syscall.h>
+#endif
+#endif
+
+const juce::Identifier ThreadSettings::treeType{"THREADS"};
+
+namespace {
+const juce::Identifier intraOpId{"intra_op_threads"};
+const juce::Identifier interOpId{"inter_op_threads"};
+const juce::Identifier affinityId{"affinity_mask"};
+const juce::Identifier realtimeId{"realtime_priority"};
+const juce::Identifier budgetId{"thread_budget"};
+
+std::mutex globalLock;
+std::optional<ThreadSettings> globalSettings;
+
+// same directory as the models, see RaveAPEditor
+juce::File getGlobalFile() {
+  juce::String path =
+      juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+          .getFullPathName();
+  if (juce::SystemStats::getOperatingSystemType() ==
+      juce::SystemStats::OperatingSystemType::MacOSX)
+    path += juce::String("/Application Support");
+  path += juce::String("/ACIDS/RAVE/threads.settings");
+  return juce::File(path);
+}
+
+juce::PropertiesFile::Options getGlobalFileOptions() {
+  juce::PropertiesFile::Options options;
+  options.storageFormat = juce::PropertiesFile::storeAsXML;
+  options.millisecondsBeforeSaving = -1;
+  return options;
+}
+
+ThreadSettings readGlobalFile() {
+  juce::PropertiesFile file(getGlobalFile(), getGlobalFileOptions());
+  ThreadSettings settings;
+  if (file.containsKey(intraOpId.toString()))
+    settings.intraOpThreads = file.getIntValue(intraOpId.toString());
+  if (file.containsKey(interOpId.toString()))
+    settings.interOpThreads = file.getIntValue(interOpId.toString());
+  if (file.containsKey(affinityId.toString()))
+    settings.affinityMask = (juce::uint32)file.getValue(affinityId.toString())
+                                .getLargeIntValue();
+  if (file.containsKey(realtimeId.toString()))
+    settings.realtimePriority = file.getBoolValue(realtimeId.toString());
+  if (file.containsKey(budgetId.toString()))
+    settings.threadBudget = file.getIntValue(budgetId.toString());
+  return settings;
+}
+
+// Pins the calling thread to mask, or gives it back every core the process
+// may use when mask is 0. Returns the mask in effect, 0 meaning not pinned.
+juce::uint32 setAffinity(juce::uint32 mask) {
+#if JUCE_WINDOWS
+  DWORD_PTR processMask = 0, systemMask = 0;
+  GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask);
+  DWORD_PTR threadMask = mask != 0 ? (DWORD_PTR)mask & processMask : processMask;
+  if (threadMask == 0 || SetThreadAffinityMask(GetCurrentThread(), threadMask) == 0)
+    return 0;
+  return mask != 0 ? (juce::uint32)threadMask : 0;
+#elif JUCE_LINUX
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  if (mask != 0) {
+    for (int core = 0; core < 32; core++)
+      if (mask & (1u << core))
+        CPU_SET(core, &cpus);
+  } else if (sched_getaffinity(getpid(), sizeof(cpus), &cpus) != 0) {
+    return 0;
+  }
+  if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0)
+    return 0;
+  return mask;
+#else
+  // macOS has no way to pin a thread to a core
+  juce::ignoreUnused(mask);
+  return 0;
+#endif
+}
+
+// Sets the calling thread to a low real-time priority, below the audio
+// threads, and falls back on the highest priority the OS grants without
+// privileges. A real-time worker still blocks between frames, and Linux
+// keeps 5% of each period for other threads anyway.
+ThreadReport::Priority setPriority(bool realtime) {
+#if JUCE_WINDOWS
+  if (!realtime) {
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_NORMAL);
+    return ThreadReport::Priority::normal;
+  }
+  if (SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL))
+    return ThreadReport::Priority::realtime;
+  if (SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST))
+    return ThreadReport::Priority::elevated;
+  return ThreadReport::Priority::normal;
+#else
+  sched_param param{};
+  if (!realtime) {
+    param.sched_priority = 0;
+    pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+#if JUCE_MAC
+    pthread_set_qos_class_self_np(QOS_CLASS_DEFAULT, 0);
+#endif
+    return ThreadReport::Priority::normal;
+  }
+  param.sched_priority = sched_get_priority_min(SCHED_FIFO);
+  if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0)
+    return ThreadReport::Priority::realtime;
+  std::cout << "[-] - real-time priority denied, keeping the inference "
+               "thread at its current priority"
+            << std::endl;
+#if JUCE_MAC
+  if (pthread_set_qos_class_self_np(QOS_CLASS_USER_INTERACTIVE, 0) == 0)
+    return ThreadReport::Priority::elevated;
+#endif
+  return ThreadReport::Priority::normal;
+#endif
+}
+} // namespace
+
+ThreadSettings ThreadSettings::over(const ThreadSettings &fallback) const {
+  ThreadSettings merged = fallback;
+  if (intraOpThreads)
+    merged.intraOpThreads = intraOpThreads;
+  if (interOpThreads)
+    merged.interOpThreads = interOpThreads;
+  if (affinityMask)
+    merged.affinityMask = affinityMask;
+  if (realtimePriority)
+    merged.realtimePriority = realtimePriority;
+  if (threadBudget)
+    merged.threadBudget = threadBudget;
+  return merged;
+}
+
+juce::ValueTree ThreadSettings::toValueTree() const {
+  juce::ValueTree tree(treeType);
+  if (intraOpThreads)
+    tree.setProperty(intraOpId, *intraOpThreads, nullptr);
+  if (interOpThreads)
+    tree.setProperty(interOpId, *interOpThreads, nullptr);
+  if (affinityMask)
+    tree.setProperty(affinityId, (juce::int64)*affinityMask, nullptr);
+  if (realtimePriority)
+    tree.setProperty(realtimeId, *realtimePriority, nullptr);
+  if (threadBudget)
+    tree.setProperty(budgetId, *threadBudget, nullptr);
+  return tree;
+}
+
+ThreadSettings ThreadSettings::fromValueTree(const juce::ValueTree &tree) {
+  ThreadSettings settings;
+  if (tree.hasProperty(intraOpId))
+    settings.intraOpThreads = (int)tree[intraOpId];
+  if (tree.hasProperty(interOpId))
+    settings.interOpThreads = (int)tree[interOpId];
+  if (tree.hasProperty(affinityId))
+    settings.affinityMask = (juce::uint32)(juce::int64)tree[affinityId];
+  if (tree.hasProperty(realtimeId))
+    settings.realtimePriority = (bool)tree[realtimeId];
+  if (tree.hasProperty(budgetId))
+    settings.threadBudget = (int)tree[budgetId];
+  return settings;
+}
+
+ThreadSettings ThreadSettings::getGlobal() {
+  std::lock_guard<std::mutex> lock(globalLock);
+  if (!globalSettings)
+    globalSettings = readGlobalFile();
+  return *globalSettings;
+}
+
+void ThreadSettings::setGlobal(const ThreadSettings &settings) {
+  std::lock_guard<std::mutex> lock(globalLock);
+  globalSettings = settings;
+  auto file = getGlobalFile();
+  file.getParentDirectory().createDirectory();
+  juce::PropertiesFile properties(file, getGlobalFileOptions());
+  properties.clear();
+  auto tree = settings.toValueTree();
+  for (int i = 0; i < tree.getNumProperties(); i++) {
+    auto name = tree.getPropertyName(i);
+    properties.setValue(name.toString(), tree[name]);
+  }
+  if (!properties.saveIfNeeded())
+    std::cerr << "[-] - could not save " << file.getFullPathName() << std::endl;
+}
+
+void ThreadSettings::initialiseProcess() {
+  static std::once_flag once;
+  std::call_once(once, []() {
+    auto settings = getGlobal();
+    if (!settings.interOpThreads || *settings.interOpThreads <= 0)
+      return;
+    try {
+      at::set_num_interop_threads(*settings.interOpThreads);
+    } catch (const c10::Error &e) {
+      // the pool was started before the plugin was opened, e.g. by the host
+      std::cerr << "[-] - inter-op threads left at "
+                << at::get_num_interop_threads() << ": " << e.msg()
+                << std::endl;
+    }
+  });
+}
+
+juce::String ThreadReport::toString() const {
+  juce::String text = juce::String(intraOpThreads) + " torch threads, " +
+                      juce::String(interOpThreads) + " inter-op";
+  text += affinityMask != 0
+              ? ", pinned to 0x" + juce::String::toHexString((int)affinityMask)
+              : juce::String(", not pinned");
+  switch (priority) {
+  case Priority::realtime:
+    text += ", real-time priority";
+    break;
+  case Priority::elevated:
+    text += ", elevated priority";
+    break;
+  case Priority::normal:
+    text += ", normal priority";
+    break;
+  }
+  if (budget > 0)
+    text += " - " + juce::String(budget) + " cores shared by " +
+            juce::String(activeInstances) + " active instance" +
+            (activeInstances == 1 ? "" : "s");
+  return text;
+}
+
+void setBackgroundPriority() {
+#if JUCE_WINDOWS
+  SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+#elif JUCE_MAC
+  // utility rather than background, which only runs on the efficiency cores
+  pthread_set_qos_class_self_np(QOS_CLASS_UTILITY, 0);
+#elif JUCE_LINUX
+  // the nice value is per thread on Linux
+  setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 10);
+#endif
+}
+
+ThreadReport applyThreadSettings(const ThreadSettings &settings,
+                                 const ThreadReport &previous) {
+  ThreadReport report = previous;
+  if (TorchRuntime::isInitialised()) {
+    if (settings.intraOpThreads && *settings.intraOpThreads > 0) {
+      try {
+        at::set_num_threads(*settings.intraOpThreads);
+      } catch (const c10::Error &e) {
+        std::cerr << "[-] - torch threads: " << e.msg() << std::endl;
+      }
+    }
+    report.intraOpThreads = at::get_num_threads();
+    report.interOpThreads = at::get_num_interop_threads();
+  }
+
+  const juce::uint32 mask = settings.affinityMask.value_or(0);
+  if (mask != 0 || previous.affinityMask != 0)
+    report.affinityMask = setAffinity(mask);
+
+  const bool realtime = settings.realtimePriority.value_or(false);
+  if (realtime || previous.priority != ThreadReport::Priority::normal)
+    report.priority = setPriority(realtime);
+  return report;
+}
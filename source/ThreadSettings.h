@@ -0,0 +1,59 @@
+#pragma once
+#include <JuceHeader.h>
+#include <optional>
+
+// How inference runs on the machine: the size of torch's thread pools, the
+// cores the inference worker may run on and its priority. An instance only
+// stores what it overrides; unset fields fall back to the global settings,
+// kept next to the models, then to torch's and the OS defaults.
+struct ThreadSettings {
+  // torch's intra-op pool. The official libtorch builds use OpenMP, where it
+  // is a per-thread setting: each instance applies it on its own worker.
+  std::optional<int> intraOpThreads;
+  // torch's inter-op pool. It is process wide and cannot be resized once
+  // started, so only the global value is used, when the first instance opens.
+  std::optional<int> interOpThreads;
+  // bit n allows the worker on core n
+  std::optional<juce::uint32> affinityMask;
+  std::optional<bool> realtimePriority;
+  // Cores split between the instances that do not set their torch threads,
+  // see ThreadBudget. Global only.
+  std::optional<int> threadBudget;
+
+  // fields set here win over the ones of fallback
+  ThreadSettings over(const ThreadSettings &fallback) const;
+
+  static const juce::Identifier treeType;
+  juce::ValueTree toValueTree() const;
+  static ThreadSettings fromValueTree(const juce::ValueTree &tree);
+
+  static ThreadSettings getGlobal();
+  static void setGlobal(const ThreadSettings &settings);
+  // sizes the inter-op pool from the global settings, once per process
+  static void initialiseProcess();
+};
+
+// What the calling thread actually ended up with: the OS may refuse a
+// priority, or not support pinning
+struct ThreadReport {
+  enum class Priority { normal, elevated, realtime };
+  int intraOpThreads = 0;
+  int interOpThreads = 0;
+  juce::uint32 affinityMask = 0; // 0 when not pinned
+  Priority priority = Priority::normal;
+  // cores shared by the active instances, 0 when not known
+  int budget = 0;
+  int activeInstances = 0;
+
+  juce::String toString() const;
+};
+
+// Lowers the calling thread below the audio and inference threads, for work
+// that can wait. Threads it starts afterwards inherit it on Linux, which is
+// how torch's OpenMP pool is created.
+void setBackgroundPriority();
+
+// Applies settings to the calling thread. previous is what the thread was
+// given last time, so that a removed pinning or priority is undone.
+ThreadReport applyThreadSettings(const ThreadSettings &settings,
+                                 const ThreadReport &previous);
@@ -0,0 +1,20 @@
+#include "TorchRuntime.h"
+#include "ExecutorTuner.h"
+#include "ThreadSettings.h"
+#include <iostream>
+#include <mutex>
+
+std::atomic<bool> TorchRuntime::initialised{false};
+
+void TorchRuntime::initialise() {
+  static std::once_flag once;
+  std::call_once(once, []() {
+    const double start = juce::Time::getMillisecondCounterHiRes();
+    ThreadSettings::initialiseProcess();
+    ExecutorConfig::initialiseProcess();
+    initialised.store(true, std::memory_order_release);
+    std::cout << "[ ] RAVE - libtorch initialised in "
+              << juce::Time::getMillisecondCounterHiRes() - start << " ms"
+              << std::endl;
+  });
+}
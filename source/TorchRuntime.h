@@ -0,0 +1,20 @@
+#pragma once
+#include <atomic>
+
+// Process-wide setup of libtorch, deferred to the first model load so that
+// creating an instance, e.g. while a host scans its plugins or opens a
+// project, costs nothing on the torch side. Until then, nothing may call into
+// torch: thread settings are only recorded, and frames are silent anyway.
+class TorchRuntime {
+public:
+  // Applies the process settings (inter-op pool, executor), once. Called on
+  // the loading threads, before anything else runs torch.
+  static void initialise();
+  // real-time safe
+  static bool isInitialised() {
+    return initialised.load(std::memory_order_acquire);
+  }
+
+private:
+  static std::atomic<bool> initialised;
+};
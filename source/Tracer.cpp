@@ -0,0 +1,181 @@
+#include "Tracer.h"
+#include <ATen/record_function.h>
+#include <algorithm>
+#include <iostream>
+#include <thread>
+
+namespace {
+// start times of the torch ops running on this thread, which are nested
+constexpr int maxOpDepth = 64;
+thread_local juce::int64 opStarts[maxOpDepth];
+thread_local int opDepth = 0;
+at::CallbackHandle opCallback = 0;
+
+std::unique_ptr<at::ObserverContext> onOpStart(const at::RecordFunction &) {
+  if (opDepth < maxOpDepth)
+    opStarts[opDepth] = juce::Time::getHighResolutionTicks();
+  opDepth++;
+  return nullptr;
+}
+
+void onOpEnd(const at::RecordFunction &fn, at::ObserverContext *) {
+  // the op started before the callback was added
+  if (opDepth == 0)
+    return;
+  opDepth--;
+  auto &tracer = Tracer::getInstance();
+  if (opDepth < maxOpDepth && tracer.isEnabled())
+    tracer.complete(tracer.intern(fn.name()), "torch", opStarts[opDepth],
+                    juce::Time::getHighResolutionTicks());
+}
+
+juce::String escape(const char *text) {
+  return juce::String(text).replace("\\", "\\\\").replace("\"", "\\\"");
+}
+} // namespace
+
+Tracer &Tracer::getInstance() {
+  static Tracer instance;
+  return instance;
+}
+
+juce::File Tracer::getDefaultFile() {
+  // same directory as the models, see RaveAPEditor
+  juce::String path =
+      juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+          .getFullPathName();
+  if (juce::SystemStats::getOperatingSystemType() ==
+      juce::SystemStats::OperatingSystemType::MacOSX)
+    path += juce::String("/Application Support");
+  path += juce::String("/ACIDS/RAVE/traces/");
+  return juce::File(path).getChildFile(
+      "rave-" + juce::Time::getCurrentTime().formatted("%Y-%m-%d_%H-%M-%S") +
+      ".json");
+}
+
+bool Tracer::start(const juce::File &file, bool torchOps, size_t capacity) {
+  if (_enabled.load() || _events != nullptr)
+    return false;
+  _events = std::make_unique<Event[]>(capacity);
+  _capacity = capacity;
+  _next.store(0);
+  {
+    std::lock_guard<std::mutex> lock(_namesLock);
+    _names.clear();
+  }
+  _file = file;
+  _torchOps = torchOps;
+  _origin = juce::Time::getHighResolutionTicks();
+  if (torchOps)
+    opCallback = at::addGlobalCallback(
+        at::RecordFunctionCallback(onOpStart, onOpEnd)
+            .scopes({at::RecordScope::FUNCTION,
+                     at::RecordScope::TORCHSCRIPT_FUNCTION}));
+  _enabled.store(true);
+  std::cout << "[ ] - tracing to " << file.getFullPathName()
+            << (torchOps ? ", with torch ops" : "") << std::endl;
+  return true;
+}
+
+juce::Result Tracer::stop() {
+  if (!_enabled.exchange(false))
+    return juce::Result::fail("not tracing");
+  if (_torchOps)
+    at::removeCallback(opCallback);
+  // events being written when tracing was stopped
+  while (_writers.load() > 0)
+    std::this_thread::yield();
+
+  const size_t recorded = std::min(_next.load(), _capacity);
+  const size_t dropped = _next.load() - recorded;
+  if (dropped > 0)
+    std::cout << "[-] - trace buffer full, " << dropped << " events dropped"
+              << std::endl;
+
+  auto toMicroseconds = [](juce::int64 ticks) {
+    return juce::String(
+        juce::Time::highResolutionTicksToSeconds(ticks) * 1.0e6, 3);
+  };
+  _file.getParentDirectory().createDirectory();
+  _file.deleteFile();
+  juce::FileOutputStream out(_file);
+  if (out.failedToOpen()) {
+    _events.reset();
+    return juce::Result::fail("cannot write " + _file.getFullPathName());
+  }
+  out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+  out << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, "
+         "\"args\": {\"name\": \"RAVE\"}}";
+  for (int thread = 0; thread < maxThreads; thread++)
+    if (const char *name = _threadNames[(size_t)thread].load())
+      out << ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, "
+             "\"tid\": "
+          << thread << ", \"args\": {\"name\": \"" << escape(name) << "\"}}";
+  for (size_t i = 0; i < recorded; i++) {
+    const Event &event = _events[i];
+    out << ",\n{\"name\": \"" << escape(event.name) << "\", \"cat\": \""
+        << event.category << "\", \"ph\": \"" << juce::String::charToString(event.phase)
+        << "\", \"pid\": 1, \"tid\": " << (int)event.thread
+        << ", \"ts\": " << toMicroseconds(event.start - _origin);
+    if (event.phase == 'X')
+      out << ", \"dur\": " << toMicroseconds(event.duration);
+    else
+      out << ", \"id\": \"0x" << juce::String::toHexString((juce::int64)event.id)
+          << "\"";
+    out << "}";
+  }
+  out << "\n]}\n";
+  out.flush();
+  _events.reset();
+  std::cout << "[ ] - trace written to " << _file.getFullPathName() << " ("
+            << recorded << " events)" << std::endl;
+  return juce::Result::ok();
+}
+
+juce::uint32 Tracer::getThreadIndex() {
+  static std::atomic<juce::uint32> nextIndex{0};
+  thread_local juce::uint32 index = nextIndex.fetch_add(1);
+  return index;
+}
+
+void Tracer::setThreadName(const char *name) {
+  const juce::uint32 index = getThreadIndex();
+  if (index < (juce::uint32)maxThreads)
+    _threadNames[index].store(name, std::memory_order_relaxed);
+}
+
+const char *Tracer::intern(const char *name) {
+  std::lock_guard<std::mutex> lock(_namesLock);
+  return _names.emplace(name).first->c_str();
+}
+
+void Tracer::record(const char *name, const char *category, char phase,
+                    juce::int64 start, juce::int64 duration, juce::uint64 id) {
+  // sequentially consistent with stop(): either it sees us writing and
+  // waits, or we see tracing stopped
+  _writers.fetch_add(1);
+  if (_enabled.load()) {
+    const size_t index = _next.fetch_add(1, std::memory_order_relaxed);
+    if (index < _capacity)
+      _events[index] = {name,  category, phase, getThreadIndex(),
+                        start, duration, id};
+  }
+  _writers.fetch_sub(1);
+}
+
+void Tracer::complete(const char *name, const char *category,
+                      juce::int64 start, juce::int64 end) {
+  record(name, category, 'X', start, end - start, 0);
+}
+
+void Tracer::asyncBegin(const char *name, const char *category,
+                        juce::uint64 id) {
+  if (isEnabled())
+    record(name, category, 'b', juce::Time::getHighResolutionTicks(), 0, id);
+}
+
+void Tracer::asyncEnd(const char *name, const char *category,
+                      juce::uint64 id) {
+  if (isEnabled())
+    record(name, category, 'e', juce::Time::getHighResolutionTicks(), 0, id);
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+
+// Records timestamped spans of the pipeline, from every instance of the
+// process, and writes them as a Chrome trace (chrome://tracing, Perfetto)
+// when stopped. Recording does not allocate nor lock, so spans can be taken
+// on the audio thread: events go to a buffer allocated when tracing starts,
+// and are dropped once it is full.
+// With torch ops on, every aten op and TorchScript function call is recorded
+// too, through libtorch's RecordFunction callbacks.
+class Tracer {
+public:
+  static Tracer &getInstance();
+
+  // Returns false if a trace is already running
+  bool start(const juce::File &file, bool torchOps,
+             size_t capacity = defaultCapacity);
+  // Stops recording and writes the file
+  juce::Result stop();
+  bool isEnabled() const { return _enabled.load(std::memory_order_relaxed); }
+  juce::File getFile() const { return _file; }
+  // in the models directory, named after the current time
+  static juce::File getDefaultFile();
+
+  // name and category must outlive the trace, e.g. string literals
+  void complete(const char *name, const char *category, juce::int64 start,
+                juce::int64 end);
+  // span from one thread to another, e.g. a frame from the audio thread to
+  // the inference worker, matched by id
+  void asyncBegin(const char *name, const char *category, juce::uint64 id);
+  void asyncEnd(const char *name, const char *category, juce::uint64 id);
+  void setThreadName(const char *name);
+  // Copy of name that lives until the next trace starts, for names that may
+  // not outlive the trace. Locks, not for the audio thread.
+  const char *intern(const char *name);
+
+  // Records its own lifetime
+  class Span {
+  public:
+    explicit Span(const char *name, const char *category = "rave")
+        : _name(getInstance().isEnabled() ? name : nullptr),
+          _category(category),
+          _start(_name ? juce::Time::getHighResolutionTicks() : 0) {}
+    ~Span() {
+      if (_name != nullptr)
+        getInstance().complete(_name, _category, _start,
+                               juce::Time::getHighResolutionTicks());
+    }
+
+  private:
+    const char *_name;
+    const char *_category;
+    juce::int64 _start;
+    JUCE_DECLARE_NON_COPYABLE(Span)
+  };
+
+  static constexpr size_t defaultCapacity = 1 << 20;
+  static constexpr int maxThreads = 256;
+
+private:
+  Tracer() = default;
+  void record(const char *name, const char *category, char phase,
+              juce::int64 start, juce::int64 duration, juce::uint64 id);
+  static juce::uint32 getThreadIndex();
+
+  struct Event {
+    const char *name;
+    const char *category;
+    char phase;
+    juce::uint32 thread;
+    juce::int64 start;
+    juce::int64 duration;
+    juce::uint64 id;
+  };
+
+  std::atomic<bool> _enabled{false};
+  std::atomic<size_t> _next{0};
+  std::atomic<int> _writers{0};
+  std::unique_ptr<Event[]> _events;
+  size_t _capacity = 0;
+  juce::int64 _origin = 0;
+  juce::File _file;
+  bool _torchOps = false;
+  std::mutex _namesLock;
+  std::unordered_set<std::string> _names;
+  std::array<std::atomic<const char *>, maxThreads> _threadNames{};
+
+  JUCE_DECLARE_NON_COPYABLE(Tracer)
+};
+
+#define RAVE_TRACE(name) Tracer::Span JUCE_JOIN_MACRO(traceSpan, __LINE__)(name)
@@ -1,4 +1,6 @@
 #pragma once
+// The ring buffer the plugin used before ring_buffer, kept as the reference
+// of ring-buffer-bench only.
 #include <memory>
 
 template <class in_type, class out_type> class circular_buffer {
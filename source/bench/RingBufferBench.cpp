@@ -0,0 +1,71 @@
+// ring-buffer-bench: put / get throughput of ring_buffer against the
+// circular_buffer it replaced, with the block sizes the plugin moves.
+#include "../RingBuffer.h"
+#include "CircularBuffer.h"
+#include <JuceHeader.h>
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+namespace {
+// samples pushed through each buffer per measurement
+constexpr size_t totalSamples = size_t(1) << 26;
+constexpr int repeats = 5;
+// size of the plugin's rings, 4 * BUFFER_LENGTH (see RaveAP::resetPipeline),
+// spelled out as Rave.h needs libtorch
+constexpr size_t capacity = 4 * 32768;
+
+// Best throughput of repeats runs of fn(block) moving totalSamples samples
+// through a buffer in blocks of block samples, in Msamples/s.
+template <class Fn> double measure(size_t block, Fn &&fn) {
+  double best = 0;
+  for (int run = 0; run < repeats; run++) {
+    const double start = juce::Time::getMillisecondCounterHiRes();
+    for (size_t done = 0; done < totalSamples; done += block)
+      fn(block);
+    const double ms = juce::Time::getMillisecondCounterHiRes() - start;
+    best = std::max(best, totalSamples / (ms * 1000.0));
+  }
+  return best;
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+  std::vector<size_t> blocks = {32, 256, 2048, 16384};
+  if (argc > 1) {
+    blocks.clear();
+    for (int i = 1; i < argc; i++)
+      blocks.push_back(
+          (size_t)juce::jmax(1, juce::String(argv[i]).getIntValue()));
+  }
+
+  ring_buffer<float> ring;
+  ring.initialize(capacity);
+  circular_buffer<float, float> circular;
+  circular.initialize(capacity);
+  std::vector<float> input(*std::max_element(blocks.begin(), blocks.end()));
+  std::vector<float> output(input.size());
+  for (size_t i = 0; i < input.size(); i++)
+    input[i] = (float)i;
+
+  // a sink for the output, so that the reads are not optimized out
+  double checksum = 0;
+  std::cout << "block\tcircular_buffer\tring_buffer\t(Msamples/s, put + get)"
+            << std::endl;
+  for (size_t block : blocks) {
+    const double before = measure(block, [&](size_t n) {
+      circular.put(input.data(), (int)n);
+      circular.get(output.data(), (int)n);
+      checksum += output[n - 1];
+    });
+    const double after = measure(block, [&](size_t n) {
+      ring.put(input.data(), n);
+      ring.get(output.data(), n);
+      checksum += output[n - 1];
+    });
+    std::cout << block << "\t" << before << "\t" << after << "\t(x"
+              << after / before << ")" << std::endl;
+  }
+  std::cout << "checksum\t" << checksum << std::endl;
+  return 0;
+}
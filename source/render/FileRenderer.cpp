@@ -0,0 +1,105 @@
+#include "FileRenderer.h"
+#include "../PluginProcessor.h"
+
+FileRenderer::FileRenderer(const RenderSettings &settings)
+    : _settings(settings) {
+  _formats.registerBasicFormats();
+}
+
+juce::File FileRenderer::getOutputFile(const juce::File &input) const {
+  const juce::File directory = _settings.outputDirectory == juce::File()
+                                   ? input.getParentDirectory()
+                                   : _settings.outputDirectory;
+  return directory.getChildFile(input.getFileNameWithoutExtension() +
+                                "_rave." + _settings.format);
+}
+
+bool FileRenderer::setParameter(juce::AudioProcessor &processor,
+                                const juce::String &id, float value) {
+  for (auto *parameter : processor.getParameters()) {
+    auto *ranged = dynamic_cast<juce::RangedAudioParameter *>(parameter);
+    if (ranged != nullptr && ranged->getParameterID() == id) {
+      ranged->setValueNotifyingHost(ranged->convertTo0to1(value));
+      return true;
+    }
+  }
+  return false;
+}
+
+juce::String FileRenderer::render(const juce::File &input,
+                                  const juce::File &output) {
+  std::unique_ptr<juce::AudioFormatReader> reader(
+      _formats.createReaderFor(input));
+  if (reader == nullptr)
+    return "cannot read " + input.getFullPathName();
+  auto *format = _formats.findFormatForFileExtension(output.getFileExtension());
+  if (format == nullptr)
+    return "unknown output format " + output.getFileExtension();
+
+  const double sampleRate = reader->sampleRate;
+  const int blockSize = _settings.blockSize;
+  RaveAP processor;
+  for (const auto &parameter : _settings.parameters)
+    if (!setParameter(processor, parameter.first, parameter.second))
+      return "unknown parameter " + parameter.first;
+  if (_settings.torchThreads > 0) {
+    ThreadSettings threads;
+    threads.intraOpThreads = _settings.torchThreads;
+    processor.setThreadSettings(threads);
+  }
+  if (_settings.precision != Precision::float32)
+    processor.setPrecision(_settings.model.getFullPathName().toStdString(),
+                           _settings.precision);
+  processor.setNonRealtime(true);
+  processor.setPlayConfigDetails(2, 2, sampleRate, blockSize);
+  processor.prepareToPlay(sampleRate, blockSize);
+
+  // same loading path as the plugin, run synchronously
+  UpdateEngineJob load(processor,
+                       _settings.model.getFullPathName().toStdString(),
+                       _settings.warmUpPasses);
+  load.runJob();
+  auto engine = processor.getEngine();
+  if (engine == nullptr || !engine->isLoaded())
+    return "cannot load " + _settings.model.getFullPathName();
+  if (engine->getPrecision() != _settings.precision)
+    return "cannot run " + _settings.model.getFullPathName() + " in " +
+           getPrecisionName(_settings.precision);
+
+  output.deleteFile();
+  std::unique_ptr<juce::OutputStream> stream(output.createOutputStream());
+  if (stream == nullptr)
+    return "cannot write " + output.getFullPathName();
+  std::unique_ptr<juce::AudioFormatWriter> writer(
+      format->createWriterFor(stream.get(), sampleRate, 2, 24, {}, 0));
+  if (writer == nullptr)
+    return "cannot write " + output.getFullPathName();
+  stream.release(); // owned by the writer
+
+  // the input is followed by silence to flush the pipeline, and the output
+  // is shifted back by the processor's latency
+  const juce::int64 latency = processor.getLatencySamples();
+  const juce::int64 length = reader->lengthInSamples;
+  juce::AudioBuffer<float> buffer(2, blockSize);
+  juce::MidiBuffer midi;
+  for (juce::int64 position = 0; position < length + latency;
+       position += blockSize) {
+    const int n = (int)juce::jmin<juce::int64>(blockSize,
+                                               length + latency - position);
+    buffer.clear();
+    if (position < length) {
+      const int toRead = (int)juce::jmin<juce::int64>(n, length - position);
+      reader->read(&buffer, 0, toRead, position, true, true);
+      if (reader->numChannels == 1)
+        buffer.copyFrom(1, 0, buffer, 0, 0, toRead);
+    }
+    juce::AudioBuffer<float> block(buffer.getArrayOfWritePointers(), 2, n);
+    processor.processBlock(block, midi);
+    const int skip = (int)juce::jlimit<juce::int64>(0, n, latency - position);
+    if (!writer->writeFromAudioSampleBuffer(block, skip, n - skip))
+      return "cannot write " + output.getFullPathName();
+  }
+  _stats = processor.getPerformanceStats();
+  processor.releaseResources();
+  return {};
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include "../PerformanceMeter.h"
+#include "../Rave.h"
+#include <JuceHeader.h>
+#include <map>
+
+struct RenderSettings {
+  juce::File model;
+  // next to each input file when not set
+  juce::File outputDirectory;
+  // "wav" or "flac"
+  juce::String format = "wav";
+  int blockSize = 4096;
+  int warmUpPasses = DEFAULT_WARMUP_PASSES;
+  // torch threads of each job, torch's default when 0
+  int torchThreads = 0;
+  // what the model computes in, see Precision
+  Precision precision = Precision::float32;
+  // parameter id -> value, in the parameter's own range
+  std::map<juce::String, float> parameters;
+};
+
+// Renders audio files offline through a RaveAP instance of its own, so
+// through the same chain as the plugin: input compressor and gain, latent
+// scale / bias, width, output gain, limiter and dry / wet. Files are read and
+// written block by block, memory does not grow with their length.
+class FileRenderer {
+public:
+  explicit FileRenderer(const RenderSettings &settings);
+
+  // Returns an error message, empty on success
+  juce::String render(const juce::File &input, const juce::File &output);
+  juce::File getOutputFile(const juce::File &input) const;
+  // timing of the last frames of the last render
+  PerformanceMeter::Stats getStats() const { return _stats; }
+
+  static bool setParameter(juce::AudioProcessor &processor,
+                           const juce::String &id, float value);
+
+private:
+  const RenderSettings _settings;
+  juce::AudioFormatManager _formats;
+  PerformanceMeter::Stats _stats;
+
+  JUCE_DECLARE_NON_COPYABLE(FileRenderer)
+};
@@ -0,0 +1,193 @@
+// rave-render: runs audio files through a RAVE model without a DAW.
+#include "../PluginProcessor.h"
+#include "../Tracer.h"
+#include "FileRenderer.h"
+#include "PrecisionReport.h"
+#include <JuceHeader.h>
+#include <atomic>
+#include <iostream>
+#include <optional>
+
+static void printUsage() {
+  std::cout
+      << "usage: rave-render -m model.ts [options] input...\n"
+         "\n"
+         "  -m, --model <file>     RAVE model to run\n"
+         "  -o, --output <dir>     output directory (default: next to the "
+         "inputs)\n"
+         "  -f, --format wav|flac  output format (default: wav)\n"
+         "  -j, --jobs <n>         files rendered in parallel (default: 1)\n"
+         "  -b, --block <n>        block size (default: 4096)\n"
+         "  -t, --threads <n>      torch threads per job (default: torch's, "
+         "or the\n"
+         "                         plugin's global thread settings)\n"
+         "  -q, --int8             run the convolutions in int8\n"
+         "      --bf16             run the model in bfloat16\n"
+         "  -w, --warmup <n>       warm-up passes per frame size (default: "
+      << DEFAULT_WARMUP_PASSES
+      << ")\n"
+         "  -p, --params <file>    JSON object of parameter values\n"
+         "  -s, --set <id>=<value> parameter value, overrides --params\n"
+         "      --list-params      list the parameters and exit\n"
+         "      --trace <file>     write a Chrome trace of the render\n"
+         "      --compare-int8     compare int8 with float32 on the first input\n"
+         "                         (default: a sweep) and exit\n"
+         "      --compare-bf16     same with bfloat16\n"
+         "      --trace-torch      include torch ops in the trace\n"
+         "\n"
+         "Inputs are audio files or directories of audio files.\n";
+}
+
+static void listParameters() {
+  RaveAP processor;
+  for (auto *parameter : processor.getParameters())
+    if (auto *ranged = dynamic_cast<juce::RangedAudioParameter *>(parameter)) {
+      const auto range = ranged->getNormalisableRange();
+      std::cout << ranged->getParameterID() << " [" << range.start << ", "
+                << range.end << "], default "
+                << range.convertFrom0to1(ranged->getDefaultValue())
+                << std::endl;
+    }
+}
+
+// Reads {"id": value, ...} into settings.parameters
+static bool readParameters(const juce::File &file, RenderSettings &settings) {
+  const juce::var json = juce::JSON::parse(file);
+  auto *object = json.getDynamicObject();
+  if (object == nullptr)
+    return false;
+  for (const auto &property : object->getProperties())
+    settings.parameters[property.name.toString()] = (float)property.value;
+  return true;
+}
+
+static void addInputs(const juce::File &file, juce::Array<juce::File> &inputs) {
+  if (file.isDirectory())
+    inputs.addArray(file.findChildFiles(juce::File::findFiles, false,
+                                        "*.wav;*.flac;*.aif;*.aiff"));
+  else
+    inputs.add(file);
+}
+
+int main(int argc, char *argv[]) {
+  juce::ScopedJuceInitialiser_GUI juceInitialiser;
+  RenderSettings settings;
+  juce::Array<juce::File> inputs;
+  int jobs = 1;
+  std::map<juce::String, float> overrides;
+  juce::File traceFile;
+  bool traceTorch = false;
+  std::optional<Precision> compared;
+
+  for (int i = 1; i < argc; i++) {
+    const juce::String arg(argv[i]);
+    auto value = [&]() -> juce::String {
+      if (i + 1 >= argc) {
+        std::cerr << "[-] missing value for " << arg << std::endl;
+        std::exit(1);
+      }
+      return juce::String(argv[++i]);
+    };
+    auto file = [](const juce::String &path) {
+      return juce::File::getCurrentWorkingDirectory().getChildFile(path);
+    };
+    if (arg == "-h" || arg == "--help") {
+      printUsage();
+      return 0;
+    } else if (arg == "--list-params") {
+      listParameters();
+      return 0;
+    } else if (arg == "-m" || arg == "--model") {
+      settings.model = file(value());
+    } else if (arg == "-o" || arg == "--output") {
+      settings.outputDirectory = file(value());
+    } else if (arg == "-f" || arg == "--format") {
+      settings.format = value().toLowerCase();
+    } else if (arg == "-j" || arg == "--jobs") {
+      jobs = juce::jmax(1, value().getIntValue());
+    } else if (arg == "-b" || arg == "--block") {
+      settings.blockSize = juce::jmax(32, value().getIntValue());
+    } else if (arg == "-t" || arg == "--threads") {
+      settings.torchThreads = juce::jmax(1, value().getIntValue());
+    } else if (arg == "-w" || arg == "--warmup") {
+      settings.warmUpPasses = juce::jmax(1, value().getIntValue());
+    } else if (arg == "--trace") {
+      traceFile = file(value());
+    } else if (arg == "--trace-torch") {
+      traceTorch = true;
+    } else if (arg == "-q" || arg == "--int8") {
+      settings.precision = Precision::int8;
+    } else if (arg == "--bf16") {
+      settings.precision = Precision::bfloat16;
+    } else if (arg == "--compare-int8") {
+      compared = Precision::int8;
+    } else if (arg == "--compare-bf16") {
+      compared = Precision::bfloat16;
+    } else if (arg == "-p" || arg == "--params") {
+      const juce::File params = file(value());
+      if (!readParameters(params, settings)) {
+        std::cerr << "[-] cannot read parameters from "
+                  << params.getFullPathName() << std::endl;
+        return 1;
+      }
+    } else if (arg == "-s" || arg == "--set") {
+      const juce::String assignment = value();
+      overrides[assignment.upToFirstOccurrenceOf("=", false, false).trim()] =
+          assignment.fromFirstOccurrenceOf("=", false, false).getFloatValue();
+    } else if (arg.startsWith("-")) {
+      std::cerr << "[-] unknown option " << arg << std::endl;
+      printUsage();
+      return 1;
+    } else {
+      addInputs(file(arg), inputs);
+    }
+  }
+  for (const auto &parameter : overrides)
+    settings.parameters[parameter.first] = parameter.second;
+
+  if (compared && settings.model.existsAsFile())
+    return reportPrecision(settings, *compared,
+                           inputs.isEmpty() ? juce::File() : inputs[0]);
+  if (!settings.model.existsAsFile() || inputs.isEmpty()) {
+    printUsage();
+    return 1;
+  }
+  if (settings.format != "wav" && settings.format != "flac") {
+    std::cerr << "[-] unsupported format " << settings.format << std::endl;
+    return 1;
+  }
+  if (settings.outputDirectory != juce::File())
+    settings.outputDirectory.createDirectory();
+
+  if (traceFile != juce::File())
+    Tracer::getInstance().start(traceFile, traceTorch);
+
+  // one processor per file, the model itself is loaded once (ModelCache)
+  std::atomic<int> failures{0};
+  juce::CriticalSection printLock;
+  juce::ThreadPool pool(jobs);
+  for (const auto &input : inputs) {
+    pool.addJob([&settings, &failures, &printLock, input]() {
+      FileRenderer renderer(settings);
+      const juce::File output = renderer.getOutputFile(input);
+      const juce::String error = renderer.render(input, output);
+      const juce::ScopedLock lock(printLock);
+      if (error.isEmpty()) {
+        std::cout << "[+] " << input.getFullPathName() << " -> "
+                  << output.getFullPathName() << std::endl;
+      } else {
+        std::cerr << "[-] " << input.getFullPathName() << ": " << error
+                  << std::endl;
+        failures++;
+      }
+    });
+  }
+  while (pool.getNumJobs() > 0)
+    juce::Thread::sleep(50);
+  if (Tracer::getInstance().isEnabled()) {
+    const auto result = Tracer::getInstance().stop();
+    if (result.failed())
+      std::cerr << "[-] " << result.getErrorMessage() << std::endl;
+  }
+  return failures.load() == 0 ? 0 : 1;
+}
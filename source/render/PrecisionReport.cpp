@@ -0,0 +1,146 @@
+#include "PrecisionReport.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace {
+constexpr int fftOrder = 11;
+constexpr int fftSize = 1 << fftOrder;
+constexpr int hopSize = fftSize / 4;
+
+// 10 s of a log sweep with two harmonics, and a burst of noise every second
+juce::File writeReference(const juce::File &directory) {
+  const double sampleRate = 44100.0;
+  const int length = (int)(10 * sampleRate);
+  juce::AudioBuffer<float> buffer(1, length);
+  juce::Random random(0);
+  double phase = 0;
+  for (int i = 0; i < length; i++) {
+    const double t = i / sampleRate;
+    const double frequency = 40.0 * std::pow(400.0, t / 10.0);
+    phase += juce::MathConstants<double>::twoPi * frequency / sampleRate;
+    float sample = (float)(0.4 * std::sin(phase) + 0.2 * std::sin(2 * phase) +
+                           0.1 * std::sin(3 * phase));
+    if (std::fmod(t, 1.0) < 0.1)
+      sample += 0.3f * (random.nextFloat() * 2.f - 1.f);
+    buffer.setSample(0, i, sample);
+  }
+  const juce::File file = directory.getChildFile("reference.wav");
+  std::unique_ptr<juce::OutputStream> stream(file.createOutputStream());
+  juce::WavAudioFormat wav;
+  std::unique_ptr<juce::AudioFormatWriter> writer(
+      wav.createWriterFor(stream.get(), sampleRate, 1, 24, {}, 0));
+  if (writer == nullptr)
+    return {};
+  stream.release(); // owned by the writer
+  writer->writeFromAudioSampleBuffer(buffer, 0, length);
+  return file;
+}
+
+// first channel of file
+std::vector<float> readMono(const juce::File &file) {
+  juce::AudioFormatManager formats;
+  formats.registerBasicFormats();
+  std::unique_ptr<juce::AudioFormatReader> reader(
+      formats.createReaderFor(file));
+  if (reader == nullptr)
+    return {};
+  juce::AudioBuffer<float> buffer(1, (int)reader->lengthInSamples);
+  reader->read(&buffer, 0, buffer.getNumSamples(), 0, true, false);
+  return std::vector<float>(buffer.getReadPointer(0),
+                            buffer.getReadPointer(0) + buffer.getNumSamples());
+}
+
+// dB magnitude spectra, one per hop
+std::vector<std::vector<float>> spectrogram(const std::vector<float> &signal) {
+  juce::dsp::FFT fft(fftOrder);
+  juce::dsp::WindowingFunction<float> window(
+      fftSize, juce::dsp::WindowingFunction<float>::hann, false);
+  std::vector<std::vector<float>> frames;
+  std::vector<float> data(2 * fftSize);
+  for (size_t start = 0; start + fftSize <= signal.size(); start += hopSize) {
+    std::fill(data.begin(), data.end(), 0.f);
+    std::copy(signal.begin() + (long)start,
+              signal.begin() + (long)start + fftSize, data.begin());
+    window.multiplyWithWindowingTable(data.data(), fftSize);
+    fft.performFrequencyOnlyForwardTransform(data.data());
+    std::vector<float> frame(fftSize / 2 + 1);
+    for (size_t bin = 0; bin < frame.size(); bin++)
+      frame[bin] = juce::Decibels::gainToDecibels(data[bin], -100.f);
+    frames.push_back(std::move(frame));
+  }
+  return frames;
+}
+
+// root mean square of the dB difference over the bins, averaged over frames
+double logSpectralDistance(const std::vector<float> &a,
+                           const std::vector<float> &b) {
+  const auto sa = spectrogram(a);
+  const auto sb = spectrogram(b);
+  const size_t frames = std::min(sa.size(), sb.size());
+  if (frames == 0)
+    return 0;
+  double total = 0;
+  for (size_t f = 0; f < frames; f++) {
+    double sum = 0;
+    for (size_t bin = 0; bin < sa[f].size(); bin++)
+      sum += std::pow(sa[f][bin] - sb[f][bin], 2.0);
+    total += std::sqrt(sum / sa[f].size());
+  }
+  return total / frames;
+}
+} // namespace
+
+int reportPrecision(const RenderSettings &settings, Precision precision,
+                    const juce::File &reference) {
+  const juce::File directory =
+      juce::File::getSpecialLocation(juce::File::tempDirectory)
+          .getNonexistentChildFile("rave-" + getPrecisionName(precision), "");
+  directory.createDirectory();
+  const juce::File input =
+      reference.existsAsFile() ? reference : writeReference(directory);
+  if (!input.existsAsFile()) {
+    std::cerr << "[-] cannot write the reference signal" << std::endl;
+    directory.deleteRecursively();
+    return 1;
+  }
+
+  struct Run {
+    juce::String name;
+    Precision precision;
+    juce::File output;
+    PerformanceMeter::Stats stats;
+  };
+  Run runs[] = {{"float32", Precision::float32, {}, {}},
+                {getPrecisionName(precision), precision, {}, {}},
+                {"float32 again", Precision::float32, {}, {}}};
+  for (auto &run : runs) {
+    RenderSettings runSettings = settings;
+    runSettings.precision = run.precision;
+    FileRenderer renderer(runSettings);
+    run.output = directory.getChildFile(run.name.replace(" ", "_") + ".wav");
+    const juce::String error = renderer.render(input, run.output);
+    if (error.isNotEmpty()) {
+      std::cerr << "[-] " << run.name << ": " << error << std::endl;
+      directory.deleteRecursively();
+      return 1;
+    }
+    run.stats = renderer.getStats();
+    std::cout << run.name << ": " << run.stats.p50Ms[PerformanceMeter::total]
+              << " ms per frame (p50), "
+              << run.stats.p99Ms[PerformanceMeter::total] << " ms (p99), "
+              << "real-time factor " << run.stats.realtimeFactor << std::endl;
+  }
+
+  const auto reference32 = readMono(runs[0].output);
+  const double error = logSpectralDistance(reference32, readMono(runs[1].output));
+  const double floor = logSpectralDistance(reference32, readMono(runs[2].output));
+  if (runs[1].stats.realtimeFactor > 0)
+    std::cout << "speedup: "
+              << runs[0].stats.realtimeFactor / runs[1].stats.realtimeFactor
+              << "x" << std::endl;
+  std::cout << "log spectral distance to float32: " << error
+            << " dB (float32 to itself: " << floor << " dB)" << std::endl;
+  directory.deleteRecursively();
+  return 0;
+}
@@ -0,0 +1,10 @@
+#pragma once
+#include "FileRenderer.h"
+
+// A/B of a model in precision against float32: renders the reference through
+// both, and through float32 again as the model itself may be random, then
+// prints the time per frame, the speedup and the log spectral distance
+// between the outputs. Without a reference, a sweep with noise bursts is
+// used. Returns the process exit code.
+int reportPrecision(const RenderSettings &settings, Precision precision,
+                    const juce::File &reference);
@@ -0,0 +1,128 @@
+// rave-realtime-test: drives a RaveAP the way a host does, in a build with
+// the real-time checks on (see RealtimeChecker.h). Any allocation or lock
+// inside processBlock aborts the process, which fails the test.
+//
+// usage: rave-realtime-test [model.ts]
+// Without a model, only the steps that do not need one run.
+#include "../PluginProcessor.h"
+#include <JuceHeader.h>
+#include <cmath>
+#include <iostream>
+
+namespace {
+constexpr double sampleRate = 44100.0;
+constexpr int blockSize = 512;
+// longest a model may take to load, warm up and swap in
+constexpr double loadTimeoutMs = 120000.0;
+
+void setParameter(RaveAP &processor, const juce::String &id, float value) {
+  for (auto *parameter : processor.getParameters())
+    if (auto *ranged = dynamic_cast<juce::RangedAudioParameter *>(parameter))
+      if (ranged->getParameterID() == id)
+        ranged->setValueNotifyingHost(ranged->convertTo0to1(value));
+}
+
+// Plays ms of a sine through processor, at the pace of the audio so that
+// the worker computes the frames as it would in a host
+void play(RaveAP &processor, double ms) {
+  static double phase = 0;
+  juce::AudioBuffer<float> buffer(2, blockSize);
+  juce::MidiBuffer midi;
+  const int blocks = juce::jmax(1, (int)(ms / 1000.0 * sampleRate / blockSize));
+  for (int block = 0; block < blocks; block++) {
+    for (int i = 0; i < blockSize; i++) {
+      const float sample = (float)(0.5 * std::sin(phase));
+      phase += juce::MathConstants<double>::twoPi * 220.0 / sampleRate;
+      buffer.setSample(0, i, sample);
+      buffer.setSample(1, i, sample);
+    }
+    processor.processBlock(buffer, midi);
+    juce::Thread::sleep((int)(blockSize * 1000.0 / sampleRate));
+  }
+}
+
+// Plays until the engine is no longer previous and has a model, false on
+// timeout
+bool playUntilSwapped(RaveAP &processor, const RAVE *previous) {
+  const double start = juce::Time::getMillisecondCounterHiRes();
+  while (juce::Time::getMillisecondCounterHiRes() - start < loadTimeoutMs) {
+    play(processor, 100);
+    auto engine = processor.getEngine();
+    if (engine != nullptr && engine.get() != previous && engine->isLoaded())
+      return true;
+  }
+  return false;
+}
+
+// every latency mode, then the automatic one
+void changeLatency(RaveAP &processor) {
+  for (int mode = 9; mode <= 15; mode++) {
+    setParameter(processor, rave_parameters::latency_mode, (float)mode);
+    play(processor, 300);
+  }
+  setParameter(processor, rave_parameters::latency_auto, 1.f);
+  play(processor, 1000);
+  setParameter(processor, rave_parameters::latency_auto, 0.f);
+  setParameter(processor, rave_parameters::latency_mode, 13.f);
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+  juce::ScopedJuceInitialiser_GUI juceInitialiser;
+  RaveAP processor;
+  processor.setPlayConfigDetails(2, 2, sampleRate, blockSize);
+  processor.prepareToPlay(sampleRate, blockSize);
+
+  std::cout << "[ ] no model" << std::endl;
+  play(processor, 500);
+  changeLatency(processor);
+  // the host changes its setup
+  processor.releaseResources();
+  processor.prepareToPlay(sampleRate, blockSize);
+  play(processor, 500);
+
+  if (argc < 2) {
+    std::cout << "[ ] no model given, skipping the model steps" << std::endl;
+    return 0;
+  }
+  const std::string model = juce::File::getCurrentWorkingDirectory()
+                                .getChildFile(argv[1])
+                                .getFullPathName()
+                                .toStdString();
+
+  std::cout << "[ ] loading " << model << std::endl;
+  auto engine = processor.getEngine();
+  const RAVE *previous = engine.get();
+  engine.reset();
+  processor.updateEngine(model);
+  if (!playUntilSwapped(processor, previous)) {
+    std::cerr << "[-] cannot load " << model << std::endl;
+    return 1;
+  }
+  play(processor, 2000);
+
+  std::cout << "[ ] latency changes" << std::endl;
+  changeLatency(processor);
+  play(processor, 1000);
+
+  std::cout << "[ ] swap" << std::endl;
+  previous = processor.getEngine().get();
+  // reloads the model playing, which crossfades to the new engine
+  processor.setPrecision(model, Precision::float32);
+  if (!playUntilSwapped(processor, previous)) {
+    std::cerr << "[-] cannot reload " << model << std::endl;
+    return 1;
+  }
+  play(processor, 2000);
+
+  std::cout << "[ ] offline render" << std::endl;
+  // as AU hosts do, without preparing again
+  processor.setNonRealtime(true);
+  play(processor, 1000);
+  processor.setNonRealtime(false);
+  play(processor, 1000);
+
+  processor.releaseResources();
+  std::cout << "[ ] no real-time violation" << std::endl;
+  return 0;
+}
@@ -22,7 +22,16 @@ public:
     addAndMakeVisible(_compressorPanel);
     addAndMakeVisible(_outputPanel);
     addAndMakeVisible(_latencyComboBox);
+    addAndMakeVisible(_autoLatencyToggle);
+    addAndMakeVisible(_batchToggle);
     addAndMakeVisible(_foldButton);
+    _batchToggle.setButtonText("Batch with other instances");
+    _batchToggle.setTooltip("Decode together with the other instances "
+                            "running the same model");
+    _autoLatencyToggle.setButtonText("Auto");
+    _autoLatencyToggle.setTooltip("Follow the model's inference time: the "
+                                  "smallest buffer size computed in time");
+    _autoLatencyToggle.onClick = [this]() { updateLatencyComboBox(); };
 
     // Fold panel button stuff
     _foldButton.onClick = [this]() {
@@ -55,6 +64,10 @@ public:
 
     _latencyComboBoxAttachement.reset(new ComboBoxAttachment(
         vts, rave_parameters::latency_mode, _latencyComboBox));
+    _batchToggleAttachment.reset(new ButtonAttachment(
+        vts, rave_parameters::batched_inference, _batchToggle));
+    _autoLatencyToggleAttachment.reset(new ButtonAttachment(
+        vts, rave_parameters::latency_auto, _autoLatencyToggle));
   }
 
   void setBufferSizeRange(juce::Range<float> range) {
@@ -85,6 +98,25 @@ public:
     }
   }
 
+  // Streaming models follow the host block size, the latency mode does not
+  // apply to them
+  void setStreaming(bool streaming) {
+    _streaming = streaming;
+    updateLatencyComboBox();
+  }
+
+  // the buffer size is only picked by hand when neither the host nor the
+  // auto mode picks it
+  void updateLatencyComboBox() {
+    const bool automatic = _autoLatencyToggle.getToggleState();
+    _latencyComboBox.setEnabled(!_streaming && !automatic);
+    _autoLatencyToggle.setEnabled(!_streaming);
+    _latencyComboBox.setTooltip(
+        _streaming  ? "Streaming model: buffer size follows the host"
+        : automatic ? "Auto: buffer size follows the inference time"
+                    : "");
+  }
+
   void resized() override {
     auto b_area = getLocalBounds();
     Rectangle<int> b_clickableArrow;
@@ -106,9 +138,14 @@ public:
     _inputPanel.setBounds(b_area.removeFromTop(panelHeight));
     _compressorPanel.setBounds(b_area.removeFromTop(panelHeight));
     _outputPanel.setBounds(b_area.removeFromTop(panelHeight));
-    _latencyComboBox.setBounds(b_area.removeFromTop(comboHeight)
-                                   .withTrimmedLeft(UI_MARGIN_SIZE)
-                                   .withTrimmedRight(UI_MARGIN_SIZE));
+    auto b_latency = b_area.removeFromTop(comboHeight)
+                         .withTrimmedLeft(UI_MARGIN_SIZE)
+                         .withTrimmedRight(UI_MARGIN_SIZE);
+    _autoLatencyToggle.setBounds(b_latency.removeFromRight(UI_MARGIN_SIZE * 7));
+    _latencyComboBox.setBounds(b_latency);
+    _batchToggle.setBounds(b_area.removeFromTop(comboHeight)
+                               .withTrimmedLeft(UI_MARGIN_SIZE)
+                               .withTrimmedRight(UI_MARGIN_SIZE));
   }
 
   void paint(juce::Graphics &g) override {
@@ -191,6 +228,11 @@ private:
 
   ComboBox _latencyComboBox;
   std::unique_ptr<ComboBoxAttachment> _latencyComboBoxAttachement;
+  ToggleButton _autoLatencyToggle;
+  std::unique_ptr<ButtonAttachment> _autoLatencyToggleAttachment;
+  bool _streaming = false;
+  ToggleButton _batchToggle;
+  std::unique_ptr<ButtonAttachment> _batchToggleAttachment;
 
   JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(FoldablePanel)
 };
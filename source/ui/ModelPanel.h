@@ -235,7 +235,11 @@ public:
   }
 
   void timerCallback() {
+    if (_model == nullptr)
+      return;
     at::Tensor latent = _model->getLatentBuffer();
+    if (!latent.defined())
+      return;
     // TODO: A change is to be made by Axel, and we'll get a tensor with dims
     // (_latentsNbr * LINES_BUFFER_SIZE)
 
@@ -309,9 +313,9 @@ public:
     return (size_t)((int)res + 7.0);
   }
 
-  void setModel(RAVE *_rave) { 
-    _model = _rave; 
-  }
+  // Holds on to the engine until the next one is set, as it may have been
+  // swapped out of the processor in the meantime
+  void setModel(std::shared_ptr<RAVE> engine) { _model = std::move(engine); }
 
   void setSampleRate(double sampleRate) { _sr = sampleRate; }
 
@@ -328,7 +332,7 @@ public:
   }
 
 private:
-  RAVE *_model;
+  std::shared_ptr<RAVE> _model;
 
   SliderGroup _latentJitter;
   SliderGroup _width;